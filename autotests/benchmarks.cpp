@@ -0,0 +1,395 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include <QTest>
+#include <QThreadPool>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "context.h"
+#include "engine.h"
+#include "ktexttemplate_paths.h"
+#include "template.h"
+#include "templateloader.h"
+
+using namespace KTextTemplate;
+
+// Counts the allocations of the whole process, for the benchmarks which
+// report allocations rather than time.
+static std::atomic<qint64> s_allocations = 0;
+
+void *operator new(std::size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// An object with many properties, like those exposed by views.
+class BenchmarkItem : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(int p0 MEMBER m_p0 CONSTANT)
+    Q_PROPERTY(int p1 MEMBER m_p1 CONSTANT)
+    Q_PROPERTY(int p2 MEMBER m_p2 CONSTANT)
+    Q_PROPERTY(int p3 MEMBER m_p3 CONSTANT)
+    Q_PROPERTY(int p4 MEMBER m_p4 CONSTANT)
+    Q_PROPERTY(int p5 MEMBER m_p5 CONSTANT)
+    Q_PROPERTY(int p6 MEMBER m_p6 CONSTANT)
+    Q_PROPERTY(int p7 MEMBER m_p7 CONSTANT)
+    Q_PROPERTY(int p8 MEMBER m_p8 CONSTANT)
+    Q_PROPERTY(int p9 MEMBER m_p9 CONSTANT)
+    Q_PROPERTY(int p10 MEMBER m_p10 CONSTANT)
+    Q_PROPERTY(int p11 MEMBER m_p11 CONSTANT)
+    Q_PROPERTY(int p12 MEMBER m_p12 CONSTANT)
+    Q_PROPERTY(int p13 MEMBER m_p13 CONSTANT)
+    Q_PROPERTY(int p14 MEMBER m_p14 CONSTANT)
+    Q_PROPERTY(int p15 MEMBER m_p15 CONSTANT)
+public:
+    using QObject::QObject;
+
+private:
+    int m_p0 = 0;
+    int m_p1 = 1;
+    int m_p2 = 2;
+    int m_p3 = 3;
+    int m_p4 = 4;
+    int m_p5 = 5;
+    int m_p6 = 6;
+    int m_p7 = 7;
+    int m_p8 = 8;
+    int m_p9 = 9;
+    int m_p10 = 10;
+    int m_p11 = 11;
+    int m_p12 = 12;
+    int m_p13 = 13;
+    int m_p14 = 14;
+    int m_p15 = 15;
+};
+
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void benchmarkCompileLargeTemplate_data();
+    void benchmarkCompileLargeTemplate();
+
+    void benchmarkCompileTextHeavyTemplate_data();
+    void benchmarkCompileTextHeavyTemplate();
+
+    void benchmarkRenderBatch_data();
+    void benchmarkRenderBatch();
+
+    void benchmarkRenderInheritance_data();
+    void benchmarkRenderInheritance();
+
+    void benchmarkRenderNestedLoops_data();
+    void benchmarkRenderNestedLoops();
+
+    void benchmarkRenderNestedLoopsAllocations_data();
+    void benchmarkRenderNestedLoopsAllocations();
+
+    void benchmarkRenderObjectProperties();
+
+private:
+    QString largeTemplate(int repetitions) const;
+    QString nestedLoopsTemplate(int depth) const;
+
+    Engine *m_engine = nullptr;
+};
+
+void Benchmarks::initTestCase()
+{
+    m_engine = new Engine(this);
+    m_engine->setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+}
+
+QString Benchmarks::largeTemplate(int repetitions) const
+{
+    const auto chunk = QStringLiteral(
+        "<div class=\"item\">\n"
+        "  <p>Some literal text which makes up most of a typical template.</p>\n"
+        "  {# A comment #}\n"
+        "  {% if item %}\n"
+        "    <span>{{ item.name|upper }}</span>\n"
+        "  {% endif %}\n"
+        "  {% for i in items %}{{ i }}, {% endfor %}\n"
+        "</div>\n");
+
+    QString content;
+    content.reserve(chunk.size() * repetitions);
+    for (auto i = 0; i < repetitions; ++i)
+        content += chunk;
+    return content;
+}
+
+void Benchmarks::benchmarkCompileLargeTemplate_data()
+{
+    QTest::addColumn<bool>("smartTrim");
+    QTest::addColumn<int>("repetitions");
+
+    QTest::newRow("small") << false << 10;
+    QTest::newRow("large") << false << 1000;
+    QTest::newRow("small-smarttrim") << true << 10;
+    QTest::newRow("large-smarttrim") << true << 1000;
+}
+
+void Benchmarks::benchmarkCompileLargeTemplate()
+{
+    QFETCH(bool, smartTrim);
+    QFETCH(int, repetitions);
+
+    m_engine->setSmartTrimEnabled(smartTrim);
+    const auto content = largeTemplate(repetitions);
+
+    QBENCHMARK {
+        auto t = m_engine->newTemplate(content, QStringLiteral("large"));
+        QCOMPARE(t->error(), NoError);
+    }
+}
+
+void Benchmarks::benchmarkCompileTextHeavyTemplate_data()
+{
+    QTest::addColumn<bool>("smartTrim");
+
+    QTest::newRow("notrim") << false;
+    QTest::newRow("smarttrim") << true;
+}
+
+void Benchmarks::benchmarkCompileTextHeavyTemplate()
+{
+    QFETCH(bool, smartTrim);
+
+    m_engine->setSmartTrimEnabled(smartTrim);
+
+    // Roughly 200 KB of literal markup with a variable every few lines, like
+    // an email body.
+    const auto paragraph = QStringLiteral(
+        "<p style=\"margin: 0 0 12px 0; font-family: Arial, sans-serif; font-size: 14px;\">\n"
+        "  Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor\n"
+        "  incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis\n"
+        "  nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat.\n"
+        "</p>\n"
+        "<p>Dear {{ name }},</p>\n");
+
+    QString content;
+    while (content.size() < 100 * 1024)
+        content += paragraph;
+
+    QBENCHMARK {
+        auto t = m_engine->newTemplate(content, QStringLiteral("textheavy"));
+        QCOMPARE(t->error(), NoError);
+    }
+}
+
+void Benchmarks::benchmarkRenderBatch_data()
+{
+    QTest::addColumn<int>("threads");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("2") << 2;
+    QTest::newRow("4") << 4;
+    QTest::newRow("8") << 8;
+}
+
+void Benchmarks::benchmarkRenderBatch()
+{
+    QFETCH(int, threads);
+
+    m_engine->setSmartTrimEnabled(false);
+    const auto t = m_engine->newTemplate(largeTemplate(20), QStringLiteral("batch"));
+    QCOMPARE(t->error(), NoError);
+
+    const auto setup = [](qsizetype i, Context *c) {
+        c->insert(QStringLiteral("item"), QVariantHash{{QStringLiteral("name"), QStringLiteral("Recipient %1").arg(i)}});
+        c->insert(QStringLiteral("items"), QVariantList{1, 2, 3, i});
+    };
+    const auto count = 2000;
+    qsizetype size = 0;
+    const auto resultReady = [&](qsizetype, const RenderResult &result) {
+        size += result.output().size();
+    };
+
+    // The calling thread renders too.
+    QThreadPool pool;
+    if (threads > 1)
+        pool.setMaxThreadCount(threads - 1);
+
+    QBENCHMARK {
+        if (threads > 1) {
+            m_engine->renderBatch(t, count, setup, resultReady, &pool);
+        } else {
+            for (auto i = 0; i < count; ++i) {
+                Context c;
+                setup(i, &c);
+                resultReady(i, t->tryRender(&c));
+            }
+        }
+    }
+    QVERIFY(size > 0);
+}
+
+void Benchmarks::benchmarkRenderInheritance_data()
+{
+    QTest::addColumn<bool>("resolve");
+
+    QTest::newRow("dynamic") << false;
+    QTest::newRow("resolved") << true;
+}
+
+void Benchmarks::benchmarkRenderInheritance()
+{
+    QFETCH(bool, resolve);
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+    engine.setConstantTemplateResolutionEnabled(resolve);
+
+    // A chain of four templates, each overriding and extending blocks of the
+    // one before.
+    auto loader = QSharedPointer<InMemoryTemplateLoader>::create();
+    loader->setTemplate(QStringLiteral("level0"),
+                        QStringLiteral("<html>{% block head %}<title>{% block title %}Site{% endblock %}</title>{% endblock %}"
+                                       "<body>{% block nav %}nav{% endblock %}{% block content %}{% endblock %}"
+                                       "{% block footer %}footer{% endblock %}</body></html>"));
+    loader->setTemplate(QStringLiteral("level1"),
+                        QStringLiteral("{% extends 'level0' %}{% block title %}Section - {{ block.super }}{% endblock %}"
+                                       "{% block nav %}{{ block.super }} section{% endblock %}"));
+    loader->setTemplate(QStringLiteral("level2"),
+                        QStringLiteral("{% extends 'level1' %}{% block content %}<main>{% block main %}{% endblock %}</main>{% endblock %}"
+                                       "{% block footer %}{{ block.super }} section{% endblock %}"));
+    loader->setTemplate(QStringLiteral("level3"),
+                        QStringLiteral("{% extends 'level2' %}{% block title %}{{ name }} - {{ block.super }}{% endblock %}"
+                                       "{% block main %}{% for i in items %}{{ i }}{% endfor %}{% endblock %}"));
+    engine.addTemplateLoader(loader);
+
+    const auto t = engine.loadByName(QStringLiteral("level3"));
+    QCOMPARE(t->error(), NoError);
+
+    Context c;
+    c.insert(QStringLiteral("name"), QStringLiteral("Page"));
+    c.insert(QStringLiteral("items"), QVariantList{1, 2, 3});
+    QString output;
+    QBENCHMARK {
+        output = t->render(&c);
+    }
+    QCOMPARE(output,
+             QStringLiteral("<html><title>Page - Section - Site</title><body>nav section<main>123</main>footer section</body></html>"));
+}
+
+QString Benchmarks::nestedLoopsTemplate(int depth) const
+{
+    // Each loop pushes a scope per iteration, and the innermost one looks up
+    // variables from the outermost loop and from the data of the render.
+    QString content;
+    for (auto i = 0; i < depth; ++i)
+        content += QStringLiteral("{% for i%1 in items %}").arg(i);
+    content += QStringLiteral("{{ name }}{{ i0 }}");
+    for (auto i = 0; i < depth; ++i)
+        content += QStringLiteral("{% endfor %}");
+    return content;
+}
+
+void Benchmarks::benchmarkRenderNestedLoops_data()
+{
+    QTest::addColumn<int>("depth");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("2") << 2;
+    QTest::newRow("4") << 4;
+}
+
+void Benchmarks::benchmarkRenderNestedLoops()
+{
+    QFETCH(int, depth);
+
+    const auto t = m_engine->newTemplate(nestedLoopsTemplate(depth), QStringLiteral("nested"));
+    QCOMPARE(t->error(), NoError);
+
+    Context c;
+    c.insert(QStringLiteral("name"), QStringLiteral("x"));
+    c.insert(QStringLiteral("items"), QVariantList{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+    QString output;
+    QBENCHMARK {
+        output = t->render(&c);
+    }
+    auto iterations = 1;
+    for (auto i = 0; i < depth; ++i)
+        iterations *= 10;
+    QCOMPARE(output.size(), 2 * iterations);
+}
+
+void Benchmarks::benchmarkRenderNestedLoopsAllocations_data()
+{
+    benchmarkRenderNestedLoops_data();
+}
+
+void Benchmarks::benchmarkRenderNestedLoopsAllocations()
+{
+    QFETCH(int, depth);
+
+    const auto t = m_engine->newTemplate(nestedLoopsTemplate(depth), QStringLiteral("nested"));
+    QCOMPARE(t->error(), NoError);
+
+    Context c;
+    c.insert(QStringLiteral("name"), QStringLiteral("x"));
+    c.insert(QStringLiteral("items"), QVariantList{0, 1, 2, 3, 4, 5, 6, 7, 8, 9});
+
+    // The first render fills the caches of the template and the context.
+    t->render(&c);
+
+    const auto before = s_allocations.load();
+    const auto output = t->render(&c);
+    const auto allocations = s_allocations.load() - before;
+
+    QVERIFY(!output.isEmpty());
+    QTest::setBenchmarkResult(allocations, QTest::Events);
+}
+
+void Benchmarks::benchmarkRenderObjectProperties()
+{
+    const auto t = m_engine->newTemplate(QStringLiteral("{% for item in items %}{{ item.p0 }}{{ item.p15 }}{{ item.objectName }},{% endfor %}"),
+                                         QStringLiteral("objects"));
+    QCOMPARE(t->error(), NoError);
+
+    QObject parent;
+    QVariantList items;
+    for (auto i = 0; i < 100; ++i) {
+        auto item = new BenchmarkItem(&parent);
+        item->setObjectName(QStringLiteral("x"));
+        items.append(QVariant::fromValue<QObject *>(item));
+    }
+
+    Context c;
+    c.insert(QStringLiteral("items"), items);
+    QString output;
+    QBENCHMARK {
+        output = t->render(&c);
+    }
+    QCOMPARE(output, QStringLiteral("015x,").repeated(100));
+}
+
+QTEST_MAIN(Benchmarks)
+#include "benchmarks.moc"
@@ -0,0 +1,162 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "context.h"
+#include "engine.h"
+#include "ktexttemplate_paths.h"
+#include "template.h"
+#include "templateloader.h"
+
+using namespace KTextTemplate;
+
+class TestArchiveLoader : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testLoadFromArchive_data();
+    void testLoadFromArchive();
+
+    void testMedia();
+    void testInvalidArchive();
+
+private:
+    void writeFile(const QString &name, const QByteArray &content);
+
+    QTemporaryDir m_dir;
+    QString m_archive;
+};
+
+void TestArchiveLoader::writeFile(const QString &name, const QByteArray &content)
+{
+    const auto path = m_dir.filePath(QStringLiteral("templates/") + name);
+    QDir().mkpath(QFileInfo(path).path());
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+void TestArchiveLoader::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    writeFile(QStringLiteral("base.html"), "<h1>{% block title %}{% endblock %}</h1>");
+    writeFile(QStringLiteral("page.html"), "{% extends \"base.html\" %}{% block title %}{{ name }}{% endblock %}");
+    writeFile(QStringLiteral("dark/page.html"), "Dark {{ name }} \xe2\x98\xbe");
+    writeFile(QStringLiteral("dark/images/logo.png"), QByteArray("\x89PNG\r\n\x1a\n\0\1", 10));
+
+    m_archive = m_dir.filePath(QStringLiteral("templates.kta"));
+    QString errorString;
+    QVERIFY2(ArchiveTemplateLoader::writeArchive(m_archive, m_dir.filePath(QStringLiteral("templates")), &errorString), qPrintable(errorString));
+}
+
+void TestArchiveLoader::testLoadFromArchive_data()
+{
+    QTest::addColumn<QString>("theme");
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<QString>("output");
+
+    QTest::newRow("no-theme") << QString() << QStringLiteral("page.html") << QStringLiteral("<h1>Ada</h1>");
+    QTest::newRow("subdirectory") << QString() << QStringLiteral("dark/page.html") << QStringLiteral("Dark Ada ☾");
+    QTest::newRow("theme") << QStringLiteral("dark") << QStringLiteral("page.html") << QStringLiteral("Dark Ada ☾");
+    QTest::newRow("missing") << QString() << QStringLiteral("missing.html") << QString();
+    QTest::newRow("missing-in-theme") << QStringLiteral("dark") << QStringLiteral("base.html") << QString();
+}
+
+void TestArchiveLoader::testLoadFromArchive()
+{
+    QFETCH(QString, theme);
+    QFETCH(QString, name);
+    QFETCH(QString, output);
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<ArchiveTemplateLoader>::create();
+    QString errorString;
+    QVERIFY2(loader->setArchive(m_archive, &errorString), qPrintable(errorString));
+    QCOMPARE(loader->archive(), m_archive);
+    loader->setTheme(theme);
+    engine.addTemplateLoader(loader);
+
+    QCOMPARE(loader->canLoadTemplate(name), !output.isEmpty());
+    if (theme.isEmpty())
+        QVERIFY(loader->templateNames().contains(QStringLiteral("dark/page.html")));
+    else
+        QCOMPARE(loader->templateNames(), QStringList({QStringLiteral("images/logo.png"), QStringLiteral("page.html")}));
+
+    const auto t = engine.loadByName(name);
+    if (output.isEmpty()) {
+        QCOMPARE(t->error(), TagSyntaxError);
+        return;
+    }
+    QCOMPARE(t->error(), NoError);
+    Context c;
+    c.insert(QStringLiteral("name"), QStringLiteral("Ada"));
+    QCOMPARE(t->render(&c), output);
+}
+
+void TestArchiveLoader::testMedia()
+{
+    ArchiveTemplateLoader loader;
+    QVERIFY(loader.setArchive(m_archive));
+    loader.setTheme(QStringLiteral("dark"));
+
+    QCOMPARE(loader.getMediaUri(QStringLiteral("missing.png")), (std::pair<QString, QString>()));
+    QCOMPARE(loader.getMediaUri(QStringLiteral("../page.html")), (std::pair<QString, QString>()));
+    QCOMPARE(loader.getMediaUri(QStringLiteral("images/../../page.html")), (std::pair<QString, QString>()));
+    QCOMPARE(loader.getMediaUri(QStringLiteral("../../templates.kta")), (std::pair<QString, QString>()));
+    QCOMPARE(loader.getMediaUri(QStringLiteral("/images/logo.png")), (std::pair<QString, QString>()));
+
+    const auto uri = loader.getMediaUri(QStringLiteral("images/logo.png"));
+    QCOMPARE(uri.second, QStringLiteral("images/logo.png"));
+    QFile file(uri.first + uri.second);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QByteArray("\x89PNG\r\n\x1a\n\0\1", 10));
+
+    const auto mediaDirectory = m_dir.filePath(QStringLiteral("media"));
+    loader.setMediaDirectory(mediaDirectory);
+    QCOMPARE(loader.mediaDirectory(), mediaDirectory);
+    const auto extracted = loader.getMediaUri(QStringLiteral("images/logo.png"));
+    QCOMPARE(QFileInfo(extracted.first + extracted.second).absoluteFilePath(), QFileInfo(mediaDirectory + QStringLiteral("/dark/images/logo.png")).absoluteFilePath());
+    QVERIFY(QFileInfo::exists(mediaDirectory + QStringLiteral("/dark/images/logo.png")));
+}
+
+void TestArchiveLoader::testInvalidArchive()
+{
+    const auto fileName = m_dir.filePath(QStringLiteral("truncated.kta"));
+    QVERIFY(QFile::copy(m_archive, fileName));
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(20));
+    file.close();
+
+    ArchiveTemplateLoader loader;
+    QString errorString;
+    QVERIFY(!loader.setArchive(fileName, &errorString));
+    QVERIFY(!errorString.isEmpty());
+    QVERIFY(!loader.setArchive(m_dir.filePath(QStringLiteral("missing.kta"))));
+    QCOMPARE(loader.archive(), QString());
+    QVERIFY(!loader.canLoadTemplate(QStringLiteral("page.html")));
+
+    // A failed archive keeps the previous one.
+    QVERIFY(loader.setArchive(m_archive));
+    QVERIFY(!loader.setArchive(fileName));
+    QCOMPARE(loader.archive(), m_archive);
+}
+
+QTEST_MAIN(TestArchiveLoader)
+#include "testarchiveloader.moc"
@@ -12,6 +12,7 @@
 
 #include <QDebug>
 #include <QFileInfo>
+#include <QTemporaryDir>
 #include <QTest>
 
 #include "cachingloaderdecorator.h"
@@ -208,11 +209,13 @@ private Q_SLOTS:
     void initTestCase();
 
     void testObjects();
+    void testContextScopes();
 
     void testTruthiness_data();
     void testTruthiness();
 
     void testRenderAfterError();
+    void testRenderResult();
 
     void testBasicSyntax_data();
     void testBasicSyntax()
@@ -273,6 +276,12 @@ private Q_SLOTS:
     void testMediaPathSafety_data();
     void testMediaPathSafety();
 
+    void testTemplateDirSymlinks_data();
+    void testTemplateDirSymlinks();
+
+    void testTemplateFileEncoding_data();
+    void testTemplateFileEncoding();
+
     void testDynamicProperties_data();
     void testDynamicProperties()
     {
@@ -285,6 +294,10 @@ private Q_SLOTS:
     void testInsignificantWhitespace_data();
     void testInsignificantWhitespace();
 
+    void testApplyEdit_data();
+    void testApplyEdit();
+    void testApplyEditNodes();
+
     void cleanupTestCase();
 
 private:
@@ -297,6 +310,56 @@ private:
     void doTest();
 };
 
+void TestBuiltinSyntax::testContextScopes()
+{
+    const QVariantHash root{{QStringLiteral("a"), 1}, {QStringLiteral("c"), 3}};
+    Context c(root);
+    QCOMPARE(c.stackHash(0), root);
+    QCOMPARE(c.lookup(QStringLiteral("a")), QVariant(1));
+    QVERIFY(!c.lookup(QStringLiteral("nameNeverUsedInAnyContext")).isValid());
+
+    c.push();
+    c.insert(QStringLiteral("a"), 2);
+    c.insert(QStringLiteral("b"), QStringLiteral("text"));
+    QCOMPARE(Variable(QStringLiteral("a")).resolve(&c), QVariant(2));
+    QCOMPARE(Variable(QStringLiteral("c")).resolve(&c), QVariant(3));
+    const auto b = Variable(QStringLiteral("b")).resolve(&c);
+    QCOMPARE(b.userType(), qMetaTypeId<KTextTemplate::SafeString>());
+    QCOMPARE(QString(b.value<KTextTemplate::SafeString>().get()), QStringLiteral("text"));
+    QCOMPARE(c.stackHash(0), (QVariantHash{{QStringLiteral("a"), 2}, {QStringLiteral("b"), QStringLiteral("text")}}));
+    QCOMPARE(c.stackHash(1), root);
+    QVERIFY(c.stackHash(2).isEmpty());
+
+    const Context copy(c);
+    c.pop();
+    QCOMPARE(Variable(QStringLiteral("a")).resolve(&c), QVariant(1));
+    QVERIFY(!Variable(QStringLiteral("b")).resolve(&c).isValid());
+    QCOMPARE(copy.lookup(QStringLiteral("a")), QVariant(2));
+
+    // Strings are looked up as SafeStrings, but stay strings in the stack.
+    c.insert(QStringLiteral("d"), QStringLiteral("<b>"));
+    const auto d = c.lookup(QStringLiteral("d"));
+    QCOMPARE(d.userType(), qMetaTypeId<KTextTemplate::SafeString>());
+    QVERIFY(!d.value<KTextTemplate::SafeString>().isSafe());
+    QCOMPARE(c.stackHash(0).value(QStringLiteral("d")), QVariant(QStringLiteral("<b>")));
+    c.insert(QStringLiteral("d"), QVariant::fromValue(markSafe(SafeString(QStringLiteral("<b>")))));
+    QVERIFY(c.lookup(QStringLiteral("d")).value<KTextTemplate::SafeString>().isSafe());
+
+    // Names which no Variable used when they were inserted are found after
+    // one is parsed, and can be replaced through it.
+    c.insert(QStringLiteral("rootNameParsedLater"), 4);
+    c.push();
+    c.insert(QStringLiteral("scopeNameParsedLater"), 5);
+    QCOMPARE(Variable(QStringLiteral("rootNameParsedLater")).resolve(&c), QVariant(4));
+    QCOMPARE(Variable(QStringLiteral("scopeNameParsedLater")).resolve(&c), QVariant(5));
+    c.insert(QStringLiteral("scopeNameParsedLater"), 6);
+    QCOMPARE(c.stackHash(0), (QVariantHash{{QStringLiteral("scopeNameParsedLater"), 6}}));
+    c.pop();
+    c.insert(QStringLiteral("rootNameParsedLater"), 7);
+    QCOMPARE(c.lookup(QStringLiteral("rootNameParsedLater")), QVariant(7));
+    QCOMPARE(c.stackHash(0).value(QStringLiteral("rootNameParsedLater")), QVariant(7));
+}
+
 void TestBuiltinSyntax::testObjects()
 {
     {
@@ -459,6 +522,78 @@ void TestBuiltinSyntax::testRenderAfterError()
     c.insert(QStringLiteral("template_var"), QLatin1String("template2"));
     QCOMPARE(t->render(&c), QLatin1String("Ok"));
     QCOMPARE(t->error(), NoError);
+
+    // Content which fails to compile keeps the previous content, and the
+    // source it references.
+    auto content = QStringLiteral("Previous ") + QString::number(42);
+    t = engine.newTemplate(content, QStringLiteral("t"));
+    content.clear();
+    t->setContent(QStringLiteral("{% if %}"));
+    QCOMPARE(t->error(), TagSyntaxError);
+    QCOMPARE(t->render(&c), QStringLiteral("Previous 42"));
+}
+
+void TestBuiltinSyntax::testRenderResult()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    QSharedPointer<InMemoryTemplateLoader> loader(new InMemoryTemplateLoader);
+    loader->setTemplate(QStringLiteral("broken"), QStringLiteral("One\nTwo {% include \"missing\" %}"));
+    loader->setTemplate(QStringLiteral("invalid"), QStringLiteral("{{ va>r }}"));
+    loader->setTemplate(QStringLiteral("main"), QStringLiteral("Start\n{% if a %}\n{% include template_var %}{% endif %}"));
+    engine.addTemplateLoader(loader);
+
+    const auto t = engine.loadByName(QStringLiteral("main"));
+    QCOMPARE(t->error(), NoError);
+
+    Context c;
+    c.insert(QStringLiteral("a"), true);
+    c.insert(QStringLiteral("template_var"), QStringLiteral("broken"));
+
+    // The innermost failing node is reported.
+    auto result = t->tryRender(&c);
+    QCOMPARE(result.error(), TagSyntaxError);
+    QVERIFY(!result.errorString().isEmpty());
+    QCOMPARE(result.templateName(), QStringLiteral("broken"));
+    QCOMPARE(result.lineNumber(), 2);
+    QCOMPARE(result.output(), QStringLiteral("Start\n\nOne\nTwo "));
+
+    // Errors of included templates which fail to compile are reported at the
+    // include tag.
+    c.insert(QStringLiteral("template_var"), QStringLiteral("invalid"));
+    result = t->tryRender(&c);
+    QCOMPARE(result.error(), TagSyntaxError);
+    QCOMPARE(result.templateName(), QStringLiteral("main"));
+    QCOMPARE(result.lineNumber(), 3);
+
+    // tryRender does not change the error of the Template.
+    QCOMPARE(t->error(), NoError);
+
+    c.insert(QStringLiteral("template_var"), QStringLiteral("missing"));
+    result = t->tryRender(&c);
+    QCOMPARE(result.error(), TagSyntaxError);
+    QCOMPARE(result.lineNumber(), 3);
+
+    c.insert(QStringLiteral("a"), false);
+    result = t->tryRender(&c);
+    QCOMPARE(result.error(), NoError);
+    QCOMPARE(result.errorString(), QString());
+    QCOMPARE(result.lineNumber(), -1);
+    QCOMPARE(result.templateName(), QStringLiteral("main"));
+    QCOMPARE(result.output(), QStringLiteral("Start\n"));
+
+    // A Template which failed to compile is not rendered.
+    const auto invalid = engine.loadByName(QStringLiteral("invalid"));
+    QCOMPARE(invalid->error(), TagSyntaxError);
+    result = invalid->tryRender(&c);
+    QCOMPARE(result.error(), TagSyntaxError);
+    QCOMPARE(result.errorString(), invalid->errorString());
+    QCOMPARE(result.lineNumber(), -1);
+    QCOMPARE(result.output(), QString());
+
+    const auto notFound = engine.loadByName(QStringLiteral("notfound"));
+    QCOMPARE(notFound->tryRender(&c).error(), TagSyntaxError);
 }
 
 void TestBuiltinSyntax::initTestCase()
@@ -694,6 +829,20 @@ void TestBuiltinSyntax::testBasicSyntax_data()
     QTest::newRow("basic-syntax39") << "{{ \'fred\" }}" << dict << QString() << TagSyntaxError;
     QTest::newRow("basic-syntax40") << "{{ _(\'fred }}" << dict << QString() << TagSyntaxError;
     QTest::newRow("basic-syntax41") << "{{ abc|removetags:_(\'fred }}" << dict << QString() << TagSyntaxError;
+
+    // Scalars render as QVariant converts them to strings, with or without
+    // filters.
+    dict.clear();
+    dict.insert(QStringLiteral("yes"), true);
+    dict.insert(QStringLiteral("real"), 0.1);
+    dict.insert(QStringLiteral("big"), Q_INT64_C(12345678901));
+    dict.insert(QStringLiteral("small"), 1.5f);
+    dict.insert(QStringLiteral("html"), QStringLiteral("<b>"));
+    QTest::newRow("basic-syntax42") << QStringLiteral("{{ yes }} {{ real }} {{ big }} {{ small }} {{ html }}") << dict
+                                    << QStringLiteral("true 0.1 12345678901 1.5 &lt;b&gt;") << NoError;
+    QTest::newRow("basic-syntax43") << QStringLiteral("{{ yes|safe }} {{ real|safe }} {{ big|safe }} {{ small|safe }} {{ html|safe }}") << dict
+                                    << QStringLiteral("true 0.1 12345678901 1.5 <b>") << NoError;
+    QTest::newRow("basic-syntax44") << QStringLiteral("{{ 2.5 }} {{ -3 }} {{ \"<i>\" }}") << dict << QStringLiteral("2.5 -3 <i>") << NoError;
 }
 
 void TestBuiltinSyntax::testEnums_data()
@@ -1276,15 +1425,19 @@ void TestBuiltinSyntax::testTemplatePathSafety_data()
 {
     QTest::addColumn<QString>("inputPath");
     QTest::addColumn<QString>("output");
+    QTest::addColumn<bool>("indexed");
 
-    QTest::newRow("template-path-safety01") << QStringLiteral("visible_file") << QStringLiteral("visible_file");
-    QTest::newRow("template-path-safety02") << QStringLiteral("../invisible_file") << QString();
+    QTest::newRow("template-path-safety01") << QStringLiteral("visible_file") << QStringLiteral("visible_file") << false;
+    QTest::newRow("template-path-safety02") << QStringLiteral("../invisible_file") << QString() << false;
+    QTest::newRow("template-path-safety03") << QStringLiteral("visible_file") << QStringLiteral("visible_file") << true;
+    QTest::newRow("template-path-safety04") << QStringLiteral("../invisible_file") << QString() << true;
 }
 
 void TestBuiltinSyntax::testTemplatePathSafety()
 {
     QFETCH(QString, inputPath);
     QFETCH(QString, output);
+    QFETCH(bool, indexed);
 
     auto loader = new FileSystemTemplateLoader();
 
@@ -1296,6 +1449,10 @@ void TestBuiltinSyntax::testTemplatePathSafety()
     f.write(inputPath.toUtf8());
     f.close();
 
+    loader->setIndexingEnabled(indexed);
+    if (indexed)
+        QCOMPARE(loader->canLoadTemplate(inputPath), !output.isEmpty());
+
     auto t = loader->loadByName(inputPath, m_engine);
     Context c;
     if (output.isEmpty())
@@ -1303,23 +1460,33 @@ void TestBuiltinSyntax::testTemplatePathSafety()
     else
         QCOMPARE(t->render(&c), inputPath);
 
-    delete loader;
     f.remove();
+    if (indexed) {
+        // Removed files are found until the index is refreshed.
+        QCOMPARE(loader->canLoadTemplate(inputPath), !output.isEmpty());
+        loader->refreshIndex();
+        QVERIFY(!loader->canLoadTemplate(inputPath));
+    }
+    delete loader;
 }
 
 void TestBuiltinSyntax::testMediaPathSafety_data()
 {
     QTest::addColumn<QString>("inputPath");
     QTest::addColumn<QString>("output");
+    QTest::addColumn<bool>("indexed");
 
-    QTest::newRow("media-path-safety01") << QStringLiteral("visible_file") << QStringLiteral("./visible_file");
-    QTest::newRow("media-path-safety02") << QStringLiteral("../invisible_file") << QString();
+    QTest::newRow("media-path-safety01") << QStringLiteral("visible_file") << QStringLiteral("./visible_file") << false;
+    QTest::newRow("media-path-safety02") << QStringLiteral("../invisible_file") << QString() << false;
+    QTest::newRow("media-path-safety03") << QStringLiteral("visible_file") << QStringLiteral("./visible_file") << true;
+    QTest::newRow("media-path-safety04") << QStringLiteral("../invisible_file") << QString() << true;
 }
 
 void TestBuiltinSyntax::testMediaPathSafety()
 {
     QFETCH(QString, inputPath);
     QFETCH(QString, output);
+    QFETCH(bool, indexed);
 
     auto loader = new FileSystemTemplateLoader();
 
@@ -1331,6 +1498,8 @@ void TestBuiltinSyntax::testMediaPathSafety()
     f.write(inputPath.toUtf8());
     f.close();
 
+    loader->setIndexingEnabled(indexed);
+
     auto uri = loader->getMediaUri(inputPath);
     if (output.isEmpty())
         QVERIFY(uri.second.isEmpty());
@@ -1341,6 +1510,82 @@ void TestBuiltinSyntax::testMediaPathSafety()
     f.remove();
 }
 
+void TestBuiltinSyntax::testTemplateDirSymlinks_data()
+{
+    QTest::addColumn<bool>("indexed");
+
+    QTest::newRow("unindexed") << false;
+    QTest::newRow("indexed") << true;
+}
+
+void TestBuiltinSyntax::testTemplateDirSymlinks()
+{
+    QFETCH(bool, indexed);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(QDir(dir.path()).mkdir(QStringLiteral("templates")));
+    QVERIFY(QDir(dir.path()).mkdir(QStringLiteral("templates-other")));
+    const auto writeFile = [&dir](const QString &fileName) {
+        QFile file(dir.filePath(fileName));
+        return file.open(QIODevice::WriteOnly) && file.write(fileName.toUtf8()) > 0;
+    };
+    QVERIFY(writeFile(QStringLiteral("templates/t.html")));
+    QVERIFY(writeFile(QStringLiteral("templates-other/secret.html")));
+    // A loop, and a directory outside the template dir whose path starts with it.
+    if (!QFile::link(dir.filePath(QStringLiteral("templates")), dir.filePath(QStringLiteral("templates/loop")))
+        || !QFile::link(dir.filePath(QStringLiteral("templates-other")), dir.filePath(QStringLiteral("templates/other"))))
+        QSKIP("Symbolic links are not supported");
+
+    FileSystemTemplateLoader loader;
+    loader.setTemplateDirs({dir.filePath(QStringLiteral("templates"))});
+    loader.setIndexingEnabled(indexed);
+
+    const auto t = loader.loadByName(QStringLiteral("t.html"), m_engine);
+    QVERIFY(t);
+    Context c;
+    QCOMPARE(t->render(&c), QStringLiteral("templates/t.html"));
+
+    QVERIFY(!loader.loadByName(QStringLiteral("other/secret.html"), m_engine));
+    QVERIFY(loader.getMediaUri(QStringLiteral("other/secret.html")).second.isEmpty());
+}
+
+void TestBuiltinSyntax::testTemplateFileEncoding_data()
+{
+    QTest::addColumn<QByteArray>("content");
+    QTest::addColumn<QString>("output");
+
+    QTest::newRow("empty") << QByteArray() << QString();
+    QTest::newRow("ascii") << QByteArrayLiteral("Hello {{ name }}") << QStringLiteral("Hello Ada");
+    QTest::newRow("utf8") << QByteArrayLiteral("Gr\xc3\xbc\xc3\x9f {{ name }} \xe2\x82\xac") << QStringLiteral("Grüß Ada €");
+    QTest::newRow("bom") << QByteArrayLiteral("\xef\xbb\xbf{{ name }}") << QStringLiteral("Ada");
+    QTest::newRow("crlf") << QByteArrayLiteral("a\r\n{% if name %}\r\n{{ name }}{% endif %}\r\n") << QStringLiteral("a\n\nAda\n");
+    QTest::newRow("cr") << QByteArrayLiteral("a\rb\r\r\n{{ name }}\r") << QStringLiteral("a\rb\r\nAda\r");
+}
+
+void TestBuiltinSyntax::testTemplateFileEncoding()
+{
+    QFETCH(QByteArray, content);
+    QFETCH(QString, output);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QFile file(dir.filePath(QStringLiteral("t.html")));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+    file.close();
+
+    FileSystemTemplateLoader loader;
+    loader.setTemplateDirs({dir.path()});
+    const auto t = loader.loadByName(QStringLiteral("t.html"), m_engine);
+    QVERIFY(t);
+    QCOMPARE(t->error(), NoError);
+
+    Context c;
+    c.insert(QStringLiteral("name"), QStringLiteral("Ada"));
+    QCOMPARE(t->render(&c), output);
+}
+
 void TestBuiltinSyntax::testTypeAccessorsUnordered()
 {
     QFETCH(QString, input);
@@ -1950,6 +2195,102 @@ void TestBuiltinSyntax::testInsignificantWhitespace_data()
     QTest::newRow("insignificant-whitespace44") << QStringLiteral("\n{{ foo }} ") << dict << QString() << QStringLiteral("\n ");
 }
 
+void TestBuiltinSyntax::testApplyEdit_data()
+{
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<int>("position");
+    QTest::addColumn<int>("length");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<Dict>("dict");
+    QTest::addColumn<QString>("output");
+    QTest::addColumn<KTextTemplate::Error>("error");
+
+    Dict dict;
+    dict.insert(QStringLiteral("var"), QStringLiteral("value"));
+    dict.insert(QStringLiteral("list"), QVariantList{1, 2, 3});
+
+    const auto input = QStringLiteral("a{{ var }}b{% for i in list %}{{ i }},{% endfor %}c{# comment #}d");
+
+    QTest::newRow("applyedit-01") << input << 0 << 1 << QStringLiteral("A") << dict << QStringLiteral("Avalueb1,2,3,cd") << NoError;
+    QTest::newRow("applyedit-02") << input << 4 << 3 << QStringLiteral("list|length") << dict << QStringLiteral("a3b1,2,3,cd") << NoError;
+    QTest::newRow("applyedit-03") << input << 37 << 0 << QStringLiteral("-") << dict << QStringLiteral("avalueb1-,2-,3-,cd") << NoError;
+    QTest::newRow("applyedit-04") << input << 1 << 9 << QString() << dict << QStringLiteral("ab1,2,3,cd") << NoError;
+    QTest::newRow("applyedit-05") << input << 1 << 0 << QStringLiteral("{% if var %}x{% endif %}") << dict << QStringLiteral("axvalueb1,2,3,cd")
+                                  << NoError;
+    QTest::newRow("applyedit-06") << input << 51 << 2 << QStringLiteral("{") << dict << QStringLiteral("avalueb1,2,3,c{ comment #}d")
+                                  << NoError;
+    QTest::newRow("applyedit-07") << input << 0 << input.size() << QStringLiteral("{% load ktexttemplate_i18ntags %}x") << dict
+                                  << QStringLiteral("x") << NoError;
+    QTest::newRow("applyedit-08") << input << 38 << 12 << QString() << dict << QString() << UnclosedBlockTagError;
+    QTest::newRow("applyedit-09") << input << 11 << 0 << QStringLiteral("{% extends \"base\" %}") << dict << QString() << TagSyntaxError;
+}
+
+void TestBuiltinSyntax::testApplyEdit()
+{
+    QFETCH(QString, input);
+    QFETCH(int, position);
+    QFETCH(int, length);
+    QFETCH(QString, text);
+    QFETCH(Dict, dict);
+    QFETCH(QString, output);
+    QFETCH(KTextTemplate::Error, error);
+
+    auto t = m_engine->newTemplate(input, QLatin1String(QTest::currentDataTag()));
+    QCOMPARE(t->error(), NoError);
+
+    // Edit twice, so that the second edit is applied incrementally.
+    t->applyEdit(0, 0, QString());
+    QCOMPARE(t->error(), NoError);
+    t->applyEdit(position, length, text);
+    QCOMPARE(t->error(), error);
+
+    Context context(dict);
+    QCOMPARE(t->render(&context), output);
+
+    // Editing back restores the original template.
+    t->applyEdit(position, text.size(), input.mid(position, length));
+    QCOMPARE(t->error(), NoError);
+    auto reference = m_engine->newTemplate(input, QStringLiteral("reference"));
+    QCOMPARE(t->render(&context), reference->render(&context));
+}
+
+void TestBuiltinSyntax::testApplyEditNodes()
+{
+    const auto input = QStringLiteral("a{{ var }}b{% for i in list %}{{ i }},{% endfor %}c");
+    auto t = m_engine->newTemplate(input, QStringLiteral("nodes"));
+    Context context(Dict{{QStringLiteral("var"), QStringLiteral("value")}, {QStringLiteral("list"), QVariantList{1, 2}}});
+    const auto topLevelNodes = [&t] {
+        return t->findChildren<Node *>(Qt::FindDirectChildrenOnly).size();
+    };
+
+    // Nodes outside of the edited range are reused.
+    t->applyEdit(0, 0, QString());
+    auto nodes = t->nodeList();
+    t->applyEdit(4, 3, QStringLiteral("list|length"));
+    QCOMPARE(t->render(&context), QStringLiteral("a2b1,2,c"));
+    QCOMPARE(t->nodeList().first(), nodes.first());
+    QCOMPARE(t->nodeList().last(), nodes.last());
+    QVERIFY(t->nodeList().at(1) != nodes.at(1));
+    QCOMPARE(topLevelNodes(), t->nodeList().size());
+
+    // A failed edit deletes the nodes parsed before the error.
+    t->applyEdit(19, 0, QStringLiteral("{% if var %}"));
+    QCOMPARE(t->error(), UnclosedBlockTagError);
+    QCOMPARE(topLevelNodes(), 0);
+    t->applyEdit(19, 12, QString());
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(topLevelNodes(), t->nodeList().size());
+
+    // Setting the content discards the state of earlier edits.
+    t->setContent(QStringLiteral("{{ var }}{% for i in list %}{{ i }}{% endfor %}"));
+    t->applyEdit(0, 0, QStringLiteral("x"));
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(t->render(&context), QStringLiteral("xvalue12"));
+    t->applyEdit(1, 9, QStringLiteral("-"));
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(t->render(&context), QStringLiteral("x-12"));
+}
+
 QTEST_MAIN(TestBuiltinSyntax)
 #include "testbuiltins.moc"
 
@@ -8,8 +8,12 @@
 */
 
 #include <QDebug>
+#include <QDir>
 #include <QFileInfo>
+#include <QTemporaryDir>
 #include <QTest>
+#include <QThread>
+#include <QThreadPool>
 
 #include "cachingloaderdecorator.h"
 #include "context.h"
@@ -18,18 +22,80 @@
 #include "template.h"
 #include <metaenumvariable_p.h>
 
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
 using Dict = QHash<QString, QVariant>;
 
 Q_DECLARE_METATYPE(KTextTemplate::Error)
+Q_DECLARE_METATYPE(KTextTemplate::CachingLoaderDecorator::EvictionPolicy)
+Q_DECLARE_METATYPE(KTextTemplate::CachingLoaderDecorator::StalenessCheck)
 
 using namespace KTextTemplate;
 
+// Counts the templates loaded, and loads slowly enough for threads to
+// overlap.
+class SlowLoader : public InMemoryTemplateLoader
+{
+public:
+    Template loadByName(const QString &name, const Engine *engine) const override
+    {
+        ++loads;
+        QThread::msleep(50);
+        return InMemoryTemplateLoader::loadByName(name, engine);
+    }
+
+    mutable std::atomic<int> loads = 0;
+};
+
+// Fails to load templates whose names start with "throw".
+class ThrowingLoader : public InMemoryTemplateLoader
+{
+public:
+    bool canLoadTemplate(const QString &name) const override
+    {
+        return name.startsWith(QLatin1String("throw")) || InMemoryTemplateLoader::canLoadTemplate(name);
+    }
+
+    Template loadByName(const QString &name, const Engine *engine) const override
+    {
+        if (name.startsWith(QLatin1String("throw")))
+            throw std::runtime_error("load failed");
+        return InMemoryTemplateLoader::loadByName(name, engine);
+    }
+
+};
+
+// Loads templates asynchronously without the thread pool of the Engine.
+class AsyncLoader : public InMemoryTemplateLoader, public AsyncTemplateLoaderInterface
+{
+public:
+    QFuture<Template> loadByNameAsync(const QString &name, const Engine *engine, QThreadPool *pool) const override
+    {
+        Q_UNUSED(pool)
+        ++asyncLoads;
+        return QtFuture::makeReadyValueFuture(canLoadTemplate(name) ? loadByName(name, engine) : Template());
+    }
+
+    mutable std::atomic<int> asyncLoads = 0;
+};
+
 class TestCachingLoader : public QObject
 {
     Q_OBJECT
 
 private Q_SLOTS:
     void testRenderAfterError();
+    void testPrecompile();
+    void testEviction_data();
+    void testEviction();
+    void testMaximumCost();
+    void testStalenessCheck_data();
+    void testStalenessCheck();
+    void testConcurrentLoads();
+    void testLoadByNameAsync();
+    void testAsyncTemplateLoaderInterface();
 };
 
 void TestCachingLoader::testRenderAfterError()
@@ -59,5 +125,330 @@ void TestCachingLoader::testRenderAfterError()
     QCOMPARE(t->error(), NoError);
 }
 
+void TestCachingLoader::testPrecompile()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const auto writeTemplate = [&](const QString &name, const QByteArray &content) {
+        const auto path = dir.filePath(QStringLiteral("theme/") + name);
+        QDir().mkpath(QFileInfo(path).path());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(content);
+    };
+    writeTemplate(QStringLiteral("base.html"), "<h1>{% block title %}{% endblock %}</h1>");
+    writeTemplate(QStringLiteral("page.html"), "{% extends \"base.html\" %}{% block title %}Page{% endblock %}");
+    writeTemplate(QStringLiteral("sub/item.html"), "<li>{{ item }}</li>");
+    writeTemplate(QStringLiteral("broken.html"), "{% if %}");
+    writeTemplate(QStringLiteral("style.css"), "h1 { color: red; }");
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<FileSystemTemplateLoader>::create();
+    loader->setTemplateDirs({dir.path()});
+    loader->setTheme(QStringLiteral("theme"));
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    const auto names = loader->templateNames();
+    QCOMPARE(names,
+             QStringList({QStringLiteral("base.html"), QStringLiteral("broken.html"), QStringLiteral("page.html"), QStringLiteral("sub/item.html")}));
+    QCOMPARE(loader->templateNames({QStringLiteral("*.css")}), QStringList{QStringLiteral("style.css")});
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+    const auto templates = engine.precompile(names, &pool);
+    QCOMPARE(templates.size(), names.size());
+    QCOMPARE(cache->size(), names.size());
+    QCOMPARE(templates.at(1)->error(), TagSyntaxError);
+    QCOMPARE(templates.at(2)->error(), NoError);
+
+    // Later loads are served from the cache.
+    QCOMPARE(engine.loadByName(QStringLiteral("page.html")), templates.at(2));
+    Context c;
+    QCOMPARE(templates.at(2)->render(&c), QStringLiteral("<h1>Page</h1>"));
+
+    // The exception of a loader reaches the caller once the other threads
+    // are done.
+    Engine throwingEngine;
+    throwingEngine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+    auto throwingLoader = QSharedPointer<ThrowingLoader>::create();
+    QStringList throwingNames;
+    for (auto i = 0; i < 100; ++i) {
+        const auto name = QString::number(i);
+        throwingLoader->setTemplate(name, name);
+        throwingNames.append(name);
+    }
+    throwingNames[10] = QStringLiteral("throw");
+    throwingEngine.addTemplateLoader(throwingLoader);
+    QVERIFY_THROWS_EXCEPTION(std::runtime_error, throwingEngine.precompile(throwingNames, &pool));
+    throwingNames.removeAt(10);
+    const auto loaded = throwingEngine.precompile(throwingNames, &pool);
+    QCOMPARE(loaded.size(), throwingNames.size());
+    QCOMPARE(loaded.last()->render(&c), throwingNames.last());
+}
+
+void TestCachingLoader::testEviction_data()
+{
+    QTest::addColumn<CachingLoaderDecorator::EvictionPolicy>("policy");
+    QTest::addColumn<QString>("evicted");
+
+    // "a" is loaded more often, but "b" was loaded last.
+    QTest::newRow("lru") << CachingLoaderDecorator::LeastRecentlyUsed << QStringLiteral("a");
+    QTest::newRow("lfu") << CachingLoaderDecorator::LeastFrequentlyUsed << QStringLiteral("b");
+}
+
+void TestCachingLoader::testEviction()
+{
+    QFETCH(CachingLoaderDecorator::EvictionPolicy, policy);
+    QFETCH(QString, evicted);
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    QSharedPointer<InMemoryTemplateLoader> loader(new InMemoryTemplateLoader);
+    for (const auto &name : {QStringLiteral("a"), QStringLiteral("b"), QStringLiteral("c")})
+        loader->setTemplate(name, name);
+
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    cache->setMaximumSize(2);
+    cache->setEvictionPolicy(policy);
+    QCOMPARE(cache->evictionPolicy(), policy);
+    engine.addTemplateLoader(cache);
+
+    const auto a = engine.loadByName(QStringLiteral("a"));
+    QCOMPARE(engine.loadByName(QStringLiteral("a")), a);
+    QCOMPARE(engine.loadByName(QStringLiteral("a")), a);
+    const auto b = engine.loadByName(QStringLiteral("b"));
+    QCOMPARE(engine.loadByName(QStringLiteral("b")), b);
+    QCOMPARE(cache->size(), 2);
+    QCOMPARE(cache->hits(), quint64(3));
+    QCOMPARE(cache->misses(), quint64(2));
+    QCOMPARE(cache->evictions(), quint64(0));
+
+    engine.loadByName(QStringLiteral("c"));
+    QCOMPARE(cache->size(), 2);
+    QCOMPARE(cache->evictions(), quint64(1));
+    QCOMPARE(cache->misses(), quint64(3));
+
+    // The evicted template is loaded again, the other is still cached.
+    const auto kept = evicted == QLatin1String("a") ? b : a;
+    QCOMPARE(engine.loadByName(kept->objectName()), kept);
+    QVERIFY(engine.loadByName(evicted) != (evicted == QLatin1String("a") ? a : b));
+    QCOMPARE(cache->misses(), quint64(4));
+
+    // Shrinking the cache evicts immediately.
+    cache->setMaximumSize(1);
+    QCOMPARE(cache->size(), 1);
+
+    cache->resetStatistics();
+    QCOMPARE(cache->hits(), quint64(0));
+    QCOMPARE(cache->misses(), quint64(0));
+    QCOMPARE(cache->evictions(), quint64(0));
+}
+
+void TestCachingLoader::testMaximumCost()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    QSharedPointer<InMemoryTemplateLoader> loader(new InMemoryTemplateLoader);
+    loader->setTemplate(QStringLiteral("small"), QStringLiteral("{{ a }}"));
+    loader->setTemplate(QStringLiteral("large"), QStringLiteral("{% for i in list %}{{ i }}{% endfor %}").repeated(100));
+
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    engine.loadByName(QStringLiteral("small"));
+    const auto smallCost = cache->cost();
+    QVERIFY(smallCost > 0);
+    engine.loadByName(QStringLiteral("large"));
+    QVERIFY(cache->cost() > 10 * smallCost);
+    QCOMPARE(cache->size(), 2);
+
+    cache->setMaximumCost(smallCost);
+    QCOMPARE(cache->maximumCost(), smallCost);
+    QCOMPARE(cache->size(), 0);
+    QCOMPARE(cache->evictions(), quint64(2));
+    engine.loadByName(QStringLiteral("small"));
+    QCOMPARE(cache->size(), 1);
+    QCOMPARE(cache->cost(), smallCost);
+
+    // The most recent template is kept even though it exceeds the maximum.
+    const auto large = engine.loadByName(QStringLiteral("large"));
+    QCOMPARE(cache->size(), 1);
+    QCOMPARE(cache->evictions(), quint64(3));
+    QCOMPARE(engine.loadByName(QStringLiteral("large")), large);
+
+    cache->clear();
+    QCOMPARE(cache->cost(), 0);
+}
+
+void TestCachingLoader::testStalenessCheck_data()
+{
+    QTest::addColumn<CachingLoaderDecorator::StalenessCheck>("check");
+    QTest::addColumn<QByteArray>("changed");
+
+    QTest::newRow("mtime") << CachingLoaderDecorator::CheckModificationTime << QByteArrayLiteral("Changed {{ a }}");
+    // The content has the same size, and might keep the modification time
+    // on file systems with a coarse resolution.
+    QTest::newRow("hash") << CachingLoaderDecorator::CheckContentHash << QByteArrayLiteral("Other {{ a }}");
+}
+
+void TestCachingLoader::testStalenessCheck()
+{
+    QFETCH(CachingLoaderDecorator::StalenessCheck, check);
+    QFETCH(QByteArray, changed);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto writeTemplate = [&](const QByteArray &content) {
+        QFile file(dir.filePath(QStringLiteral("t.html")));
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write(content);
+    };
+    writeTemplate("First {{ a }}");
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<FileSystemTemplateLoader>::create();
+    loader->setTemplateDirs({dir.path()});
+    QCOMPARE(loader->templateFileName(QStringLiteral("t.html")), dir.filePath(QStringLiteral("t.html")));
+    QCOMPARE(loader->templateFileName(QStringLiteral("missing.html")), QString());
+
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    // Without checks, the change is not noticed.
+    Context c;
+    c.insert(QStringLiteral("a"), 1);
+    const auto first = engine.loadByName(QStringLiteral("t.html"));
+    QCOMPARE(first->render(&c), QStringLiteral("First 1"));
+    writeTemplate(changed);
+    QCOMPARE(engine.loadByName(QStringLiteral("t.html")), first);
+
+    cache->setStalenessCheck(check);
+    QCOMPARE(cache->stalenessCheck(), check);
+    QVERIFY(cache->isEmpty());
+    writeTemplate("First {{ a }}");
+    const auto reloaded = engine.loadByName(QStringLiteral("t.html"));
+    QCOMPARE(reloaded->render(&c), QStringLiteral("First 1"));
+    QCOMPARE(engine.loadByName(QStringLiteral("t.html")), reloaded);
+
+    writeTemplate(changed);
+    if (check == CachingLoaderDecorator::CheckModificationTime) {
+        QFile file(dir.filePath(QStringLiteral("t.html")));
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(QDateTime::currentDateTime().addSecs(10), QFileDevice::FileModificationTime));
+    }
+    const auto changedTemplate = engine.loadByName(QStringLiteral("t.html"));
+    QVERIFY(changedTemplate != reloaded);
+    QCOMPARE(changedTemplate->render(&c), QString::fromUtf8(changed).replace(QStringLiteral("{{ a }}"), QStringLiteral("1")));
+    QCOMPARE(engine.loadByName(QStringLiteral("t.html")), changedTemplate);
+    QCOMPARE(cache->size(), 1);
+
+    // Within the interval, the file is not checked again.
+    cache->setStalenessCheck(check, 60 * 60 * 1000);
+    QCOMPARE(cache->stalenessCheckInterval(), 60 * 60 * 1000);
+    const auto cached = engine.loadByName(QStringLiteral("t.html"));
+    writeTemplate("First {{ a }}");
+    QCOMPARE(engine.loadByName(QStringLiteral("t.html")), cached);
+
+    cache->invalidate(QStringLiteral("t.html"));
+    QVERIFY(cache->isEmpty());
+    QCOMPARE(engine.loadByName(QStringLiteral("t.html"))->render(&c), QStringLiteral("First 1"));
+}
+
+void TestCachingLoader::testConcurrentLoads()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<SlowLoader>::create();
+    loader->setTemplate(QStringLiteral("t"), QStringLiteral("{{ a }}"));
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    // The threads asking for the template at once wait for one of them to
+    // compile it.
+    const auto threadCount = 8;
+    QList<Template> templates(threadCount);
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&, i] {
+            for (auto j = 0; j < 100; ++j)
+                templates[i] = engine.loadByName(QStringLiteral("t"));
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    QCOMPARE(loader->loads.load(), 1);
+    for (const auto &t : std::as_const(templates))
+        QCOMPARE(t, templates.first());
+    QCOMPARE(cache->misses() + cache->hits(), quint64(threadCount * 100));
+
+    // Clearing the cache also clears what the threads looked up.
+    cache->clear();
+    QVERIFY(engine.loadByName(QStringLiteral("t")) != templates.first());
+    QCOMPARE(loader->loads.load(), 2);
+}
+
+void TestCachingLoader::testLoadByNameAsync()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<SlowLoader>::create();
+    loader->setTemplate(QStringLiteral("t"), QStringLiteral("{{ a }}"));
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    QThreadPool pool;
+
+    // Requests made while the template is loading share the load, and do
+    // not wait for it.
+    auto first = engine.loadByNameAsync(QStringLiteral("t"), &pool);
+    auto second = engine.loadByNameAsync(QStringLiteral("t"), &pool);
+    QVERIFY(!first.isFinished());
+    QCOMPARE(first.result(), second.result());
+    QCOMPARE(loader->loads.load(), 1);
+    QCOMPARE(first.result()->error(), NoError);
+
+    // Cached templates are reported at once.
+    const auto cached = engine.loadByNameAsync(QStringLiteral("t"), &pool);
+    QVERIFY(cached.isFinished());
+    QCOMPARE(cached.result(), first.result());
+    QCOMPARE(loader->loads.load(), 1);
+
+    const auto missing = engine.loadByNameAsync(QStringLiteral("missing"), &pool);
+    QCOMPARE(missing.result()->error(), TagSyntaxError);
+    QCOMPARE(engine.loadByName(QStringLiteral("t")), first.result());
+}
+
+void TestCachingLoader::testAsyncTemplateLoaderInterface()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<AsyncLoader>::create();
+    loader->setTemplate(QStringLiteral("t"), QStringLiteral("{{ a }}"));
+    engine.addTemplateLoader(loader);
+
+    QThreadPool pool;
+    const auto t = engine.loadByNameAsync(QStringLiteral("t"), &pool);
+    QVERIFY(t.isFinished());
+    QCOMPARE(t.result()->error(), NoError);
+    QCOMPARE(loader->asyncLoads.load(), 1);
+
+    const auto missing = engine.loadByNameAsync(QStringLiteral("missing"), &pool);
+    QVERIFY(missing.isFinished());
+    QCOMPARE(missing.result()->error(), TagSyntaxError);
+    QCOMPARE(loader->asyncLoads.load(), 2);
+}
+
 QTEST_MAIN(TestCachingLoader)
 #include "testcachingloader.moc"
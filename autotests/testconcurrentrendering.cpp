@@ -0,0 +1,210 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include <QTest>
+#include <QThreadPool>
+
+#include "cachingloaderdecorator.h"
+#include "context.h"
+#include "engine.h"
+#include "ktexttemplate_paths.h"
+#include "template.h"
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace KTextTemplate;
+
+class TestConcurrentRendering : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testConcurrentRendering_data();
+    void testConcurrentRendering();
+
+    void testRenderBatch();
+    void testRenderBatchThrows();
+
+private:
+    Engine *m_engine = nullptr;
+};
+
+void TestConcurrentRendering::initTestCase()
+{
+    m_engine = new Engine(this);
+    m_engine->setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<InMemoryTemplateLoader>::create();
+    loader->setTemplate(QStringLiteral("base"), QStringLiteral("<h1>{% block title %}Base{% endblock %}</h1>{% block content %}{% endblock %}"));
+    loader->setTemplate(QStringLiteral("item"), QStringLiteral("<li>{{ item|upper }}</li>"));
+    m_engine->addTemplateLoader(QSharedPointer<CachingLoaderDecorator>::create(loader));
+}
+
+void TestConcurrentRendering::testConcurrentRendering_data()
+{
+    QTest::addColumn<QString>("input");
+
+    QTest::newRow("filters") << QStringLiteral("{{ name|escape }} {{ items|join:\", \" }} {{ name|default:\"none\"|lower }}");
+    QTest::newRow("ifchanged") << QStringLiteral("{% for i in numbers %}{% ifchanged i %}{{ i }},{% endifchanged %}{% endfor %}");
+    QTest::newRow("cycle") << QStringLiteral("{% for i in items %}{% cycle \"a\" \"b\" %}{{ i }}{% endfor %}");
+    QTest::newRow("extends") << QStringLiteral("{% extends \"base\" %}{% block title %}{{ name }} - {{ block.super }}{% endblock %}");
+    QTest::newRow("include") << QStringLiteral("<ul>{% for item in items %}{% include \"item\" %}{% endfor %}</ul>");
+    QTest::newRow("include-variable") << QStringLiteral("{% include template %}");
+}
+
+void TestConcurrentRendering::testConcurrentRendering()
+{
+    QFETCH(QString, input);
+
+    const auto t = m_engine->newTemplate(input, QLatin1String(QTest::currentDataTag()));
+    QCOMPARE(t->error(), NoError);
+
+    const auto contextFor = [](int i) {
+        QVariantHash hash;
+        hash.insert(QStringLiteral("name"), QStringLiteral("<Name %1>").arg(i));
+        hash.insert(QStringLiteral("items"), QVariantList{QStringLiteral("a%1").arg(i), QStringLiteral("b"), QStringLiteral("c")});
+        hash.insert(QStringLiteral("numbers"), QVariantList{1, 1, i, i, 2});
+        hash.insert(QStringLiteral("template"), i % 2 ? QStringLiteral("item") : QStringLiteral("base"));
+        hash.insert(QStringLiteral("item"), i);
+        return hash;
+    };
+
+    const auto renderCount = 8;
+    QStringList expected;
+    for (auto i = 0; i < renderCount; ++i) {
+        Context c(contextFor(i));
+        expected.append(t->render(&c));
+        QCOMPARE(t->error(), NoError);
+    }
+
+    // Each thread renders the same Template with its own Contexts. Built with
+    // -DECM_ENABLE_SANITIZERS=thread this also checks for data races.
+    const auto threadCount = 8;
+    const auto iterations = 200;
+    QList<QStringList> results(threadCount);
+    std::vector<std::thread> threads;
+    for (auto thread = 0; thread < threadCount; ++thread) {
+        threads.emplace_back([&, thread] {
+            for (auto i = 0; i < iterations; ++i) {
+                const auto index = (thread + i) % renderCount;
+                Context c(contextFor(index));
+                const auto output = t->render(&c);
+                if (output != expected.at(index))
+                    results[thread].append(output);
+            }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const auto &mismatches : std::as_const(results))
+        QCOMPARE(mismatches, QStringList());
+    QCOMPARE(t->error(), NoError);
+}
+
+void TestConcurrentRendering::testRenderBatch()
+{
+    const auto t = m_engine->newTemplate(QStringLiteral("{% extends \"base\" %}{% block content %}{% include template %}{% endblock %}"), QStringLiteral("batch"));
+    QCOMPARE(t->error(), NoError);
+
+    const auto count = 100;
+    const auto setup = [](qsizetype i, Context *c) {
+        c->insert(QStringLiteral("item"), i);
+        // Every tenth render fails.
+        c->insert(QStringLiteral("template"), i % 10 ? QStringLiteral("item") : QStringLiteral("missing"));
+    };
+    const auto expected = [](qsizetype i) {
+        return i % 10 ? QStringLiteral("<h1>Base</h1><li>%1</li>").arg(i) : QStringLiteral("<h1>Base</h1>");
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+
+    std::vector<std::unique_ptr<Context>> ownedContexts;
+    QList<Context *> contexts;
+    for (auto i = 0; i < count; ++i) {
+        ownedContexts.push_back(std::make_unique<Context>());
+        setup(i, ownedContexts.back().get());
+        contexts.append(ownedContexts.back().get());
+    }
+
+    const auto results = m_engine->renderBatch(t, contexts, &pool);
+    QCOMPARE(results.size(), count);
+    for (auto i = 0; i < count; ++i) {
+        QCOMPARE(results.at(i).output(), expected(i));
+        QCOMPARE(results.at(i).error(), i % 10 ? NoError : TagSyntaxError);
+    }
+
+    QList<bool> reported(count);
+    auto errors = 0;
+    auto mismatches = 0;
+    m_engine->renderBatch(t, count, setup, [&](qsizetype i, const RenderResult &result) {
+        reported[i] = true;
+        if (result.error())
+            ++errors;
+        if (result.output() != expected(i))
+            ++mismatches;
+    });
+    QCOMPARE(reported, QList<bool>(count, true));
+    QCOMPARE(errors, count / 10);
+    QCOMPARE(mismatches, 0);
+
+    QVERIFY(m_engine->renderBatch(t, {}, &pool).isEmpty());
+}
+
+void TestConcurrentRendering::testRenderBatchThrows()
+{
+    auto t = m_engine->newTemplate(QStringLiteral("{{ i }}"), QStringLiteral("throws"));
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+    const auto count = 1000;
+
+    // The exception of a callback reaches the caller once the other threads
+    // are done, and no renders are started after it.
+    std::atomic<int> setups = 0;
+    const auto setup = [&](qsizetype i, Context *c) {
+        ++setups;
+        if (i == 10)
+            throw std::runtime_error("setup");
+        c->insert(QStringLiteral("i"), i);
+    };
+    QVERIFY_THROWS_EXCEPTION(std::runtime_error, m_engine->renderBatch(t, count, setup, [](qsizetype, const RenderResult &) { }, &pool));
+    QVERIFY(setups < count);
+
+    std::atomic<int> reported = 0;
+    const auto resultReady = [&](qsizetype, const RenderResult &) {
+        if (++reported == 5)
+            throw std::runtime_error("resultReady");
+    };
+    QVERIFY_THROWS_EXCEPTION(
+        std::runtime_error,
+        m_engine->renderBatch(t, count, [](qsizetype i, Context *c) { c->insert(QStringLiteral("i"), i); }, resultReady, &pool));
+    QVERIFY(reported < count);
+
+    // The pool can still be used.
+    QList<bool> rendered(count);
+    m_engine->renderBatch(
+        t,
+        count,
+        [](qsizetype i, Context *c) {
+            c->insert(QStringLiteral("i"), i);
+        },
+        [&](qsizetype i, const RenderResult &result) {
+            rendered[i] = result.output() == QString::number(i);
+        },
+        &pool);
+    QCOMPARE(rendered, QList<bool>(count, true));
+}
+
+QTEST_MAIN(TestConcurrentRendering)
+#include "testconcurrentrendering.moc"
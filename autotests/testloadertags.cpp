@@ -15,6 +15,7 @@
 #include <QFileInfo>
 #include <QTest>
 
+#include "cachingloaderdecorator.h"
 #include "context.h"
 #include "engine.h"
 #include "ktexttemplate_paths.h"
@@ -26,6 +27,18 @@ Q_DECLARE_METATYPE(KTextTemplate::Error)
 
 using namespace KTextTemplate;
 
+class CountingLoader : public InMemoryTemplateLoader
+{
+public:
+    Template loadByName(const QString &name, const Engine *engine) const override
+    {
+        ++loads[name];
+        return InMemoryTemplateLoader::loadByName(name, engine);
+    }
+
+    mutable QHash<QString, int> loads;
+};
+
 class TestLoaderTags : public QObject
 {
     Q_OBJECT
@@ -60,8 +73,38 @@ private Q_SLOTS:
         doTest();
     }
 
+    void testResolvedIncludeTag_data()
+    {
+        testIncludeTag_data();
+    }
+    void testResolvedIncludeTag()
+    {
+        doTest(true);
+    }
+
+    void testResolvedExtendsTag_data()
+    {
+        testExtendsTag_data();
+    }
+    void testResolvedExtendsTag()
+    {
+        doTest(true);
+    }
+
+    void testResolvedIncludeAndExtendsTag_data()
+    {
+        testIncludeAndExtendsTag_data();
+    }
+    void testResolvedIncludeAndExtendsTag()
+    {
+        doTest(true);
+    }
+
+    void testConstantTemplateResolution();
+    void testVariableParent();
+
 private:
-    void doTest();
+    void doTest(bool resolveConstantTemplates = false);
 
     QSharedPointer<InMemoryTemplateLoader> m_loader;
     Engine *m_engine;
@@ -123,13 +166,15 @@ void TestLoaderTags::testTemplateFromQrc()
     QCOMPARE(result, QStringLiteral("one-two-three-four\n\n"));
 }
 
-void TestLoaderTags::doTest()
+void TestLoaderTags::doTest(bool resolveConstantTemplates)
 {
     QFETCH(QString, input);
     QFETCH(Dict, dict);
     QFETCH(QString, output);
     QFETCH(KTextTemplate::Error, error);
 
+    m_engine->setConstantTemplateResolutionEnabled(resolveConstantTemplates);
+
     auto t = m_engine->newTemplate(input, QLatin1String(QTest::currentDataTag()));
 
     if (t->error() != NoError) {
@@ -467,6 +512,24 @@ void TestLoaderTags::testExtendsTag_data()
 
     QTest::newRow("inheritance42") << QStringLiteral("{% extends 'inheritance02'|cut:' ' %}") << dict << QStringLiteral("1234") << NoError;
 
+    // {{ block.super }} used several times, directly and in expressions
+    QTest::newRow("inheritance43") << QStringLiteral(
+        "{% extends 'inheritance36' %}{% block opt %}{{ block.super }}{{ block.super }}"
+        "{% if block.super %}{{ block.super|cut:'1' }}{% endif %}{% endblock %}")
+                                   << dict << QStringLiteral("_11_222_333_") << NoError;
+
+    // {{ block.super }} which depends on a loop in the overriding block
+    m_loader->setTemplate(QStringLiteral("inheritance44"), QStringLiteral("{% block opt %}{{ n }}{% endblock %}"));
+    QTest::newRow("inheritance45") << QStringLiteral(
+        "{% extends 'inheritance44' %}{% block opt %}{% for n in numbers %}"
+        "{{ block.super|cut:'x' }}{{ block.super }}{% endfor %}{% endblock %}")
+                                   << dict << QStringLiteral("112233") << NoError;
+
+    // {{ block.super }} of a block with side effects on the render
+    m_loader->setTemplate(QStringLiteral("inheritance46"), QStringLiteral("{% block opt %}{% cycle 'a' 'b' %}{% endblock %}"));
+    QTest::newRow("inheritance47") << QStringLiteral("{% extends 'inheritance46' %}{% block opt %}{{ block.super|safe }}{{ block.super|safe }}{% endblock %}")
+                                   << dict << QStringLiteral("ab") << NoError;
+
     dict.clear();
     // Raise exception for invalid template name
     QTest::newRow("exception01") << QStringLiteral("{% extends 'nonexistent' %}") << dict << QString() << TagSyntaxError;
@@ -532,6 +595,95 @@ void TestLoaderTags::testIncludeAndExtendsTag_data()
                                                    << NoError;
 }
 
+void TestLoaderTags::testConstantTemplateResolution()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+    engine.setConstantTemplateResolutionEnabled(true);
+
+    auto loader = QSharedPointer<CountingLoader>::create();
+    loader->setTemplate(QStringLiteral("base"), QStringLiteral("<{% block content %}{% endblock %}>"));
+    loader->setTemplate(QStringLiteral("page"), QStringLiteral("{% extends 'base' %}{% block content %}{% include \"tree\" %}{% endblock %}"));
+    // Includes itself, which is left to be loaded when rendering.
+    loader->setTemplate(QStringLiteral("tree"),
+                        QStringLiteral("{% for node in nodes %}{{ node.name }}{% with node.children as nodes %}({% include \"tree\" %}){% endwith %}{% endfor %}"));
+    auto cache = QSharedPointer<CachingLoaderDecorator>::create(loader);
+    engine.addTemplateLoader(cache);
+
+    const auto t = engine.loadByName(QStringLiteral("page"));
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(loader->loads.value(QStringLiteral("base")), 1);
+    QCOMPARE(loader->loads.value(QStringLiteral("tree")), 1);
+
+    const QVariantHash leaf{{QStringLiteral("name"), QStringLiteral("b")}};
+    const QVariantHash root{{QStringLiteral("name"), QStringLiteral("a")}, {QStringLiteral("children"), QVariantList{leaf}}};
+    Context c;
+    c.insert(QStringLiteral("nodes"), QVariantList{root});
+    for (auto i = 0; i < 3; ++i)
+        QCOMPARE(t->render(&c), QStringLiteral("<a(b())>"));
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(cache->misses(), quint64(3));
+
+    // The templates which were resolved are dependencies of the page in the
+    // cache.
+    loader->setTemplate(QStringLiteral("base"), QStringLiteral("[{% block content %}{% endblock %}]"));
+    cache->invalidate(QStringLiteral("base"));
+    QVERIFY(!cache->isEmpty());
+    const auto reloaded = engine.loadByName(QStringLiteral("page"));
+    QVERIFY(reloaded != t);
+    QCOMPARE(reloaded->render(&c), QStringLiteral("[a(b())]"));
+    QCOMPARE(loader->loads.value(QStringLiteral("base")), 2);
+
+    // A template compiled with the page also depends on what the page was
+    // compiled with.
+    loader->setTemplate(QStringLiteral("article"), QStringLiteral("{% extends 'page' %}"));
+    const auto article = engine.loadByName(QStringLiteral("article"));
+    QCOMPARE(article->render(&c), QStringLiteral("[a(b())]"));
+    loader->setTemplate(QStringLiteral("base"), QStringLiteral("<{% block content %}{% endblock %}>"));
+    cache->invalidate(QStringLiteral("base"));
+    const auto reloadedArticle = engine.loadByName(QStringLiteral("article"));
+    QVERIFY(reloadedArticle != article);
+    QCOMPARE(reloadedArticle->render(&c), QStringLiteral("<a(b())>"));
+}
+
+void TestLoaderTags::testVariableParent()
+{
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto base = engine.newTemplate(QStringLiteral("<{% block a %}A{% endblock %}{% block b %}B{% endblock %}>"), QStringLiteral("base"));
+    auto other = engine.newTemplate(QStringLiteral("({% block a %}a{% endblock %})"), QStringLiteral("other"));
+    const auto child = engine.newTemplate(QStringLiteral("{% extends parent %}{% block a %}[{{ block.super }}]{% endblock %}"), QStringLiteral("child"));
+
+    Context c;
+    c.insert(QStringLiteral("parent"), QVariant::fromValue(base));
+    for (auto i = 0; i < 2; ++i)
+        QCOMPARE(child->render(&c), QStringLiteral("<[A]B>"));
+
+    // The chain of each parent is kept, and rebuilt when the parent changes.
+    c.insert(QStringLiteral("parent"), QVariant::fromValue(other));
+    QCOMPARE(child->render(&c), QStringLiteral("([a])"));
+    base->setContent(QStringLiteral("{% block b %}b{% endblock %}{% block a %}-{% endblock %}"));
+    c.insert(QStringLiteral("parent"), QVariant::fromValue(base));
+    QCOMPARE(child->render(&c), QStringLiteral("b[-]"));
+    base->applyEdit(0, 0, QStringLiteral("!"));
+    QCOMPARE(child->render(&c), QStringLiteral("!b[-]"));
+
+    // A parent which extends another is flattened into the chain, and the
+    // blocks of the child are still found when it is rendered in a loop.
+    engine.setConstantTemplateResolutionEnabled(true);
+    auto loader = QSharedPointer<InMemoryTemplateLoader>::create();
+    loader->setTemplate(QStringLiteral("root"), QStringLiteral("{% block a %}R{% endblock %}"));
+    engine.addTemplateLoader(loader);
+    const auto middle = engine.newTemplate(QStringLiteral("{% extends 'root' %}{% block a %}M{{ block.super }}{% endblock %}"), QStringLiteral("middle"));
+    c.insert(QStringLiteral("parent"), QVariant::fromValue(middle));
+    QCOMPARE(child->render(&c), QStringLiteral("[MR]"));
+    loader->setTemplate(QStringLiteral("child"), QStringLiteral("{% extends parent %}{% block a %}[{{ block.super }}]{% endblock %}"));
+    const auto loop = engine.newTemplate(QStringLiteral("{% for i in items %}{% include 'child' %}{% endfor %}"), QStringLiteral("loop"));
+    c.insert(QStringLiteral("items"), QVariantList{1, 2, 3});
+    QCOMPARE(loop->render(&c), QStringLiteral("[MR][MR][MR]"));
+}
+
 QTEST_MAIN(TestLoaderTags)
 #include "testloadertags.moc"
 
@@ -0,0 +1,145 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include "context.h"
+#include "engine.h"
+#include "ktexttemplate_paths.h"
+#include "template.h"
+#include "templateloader.h"
+
+using Dict = QHash<QString, QVariant>;
+
+Q_DECLARE_METATYPE(KTextTemplate::Error)
+
+using namespace KTextTemplate;
+
+class TestPrecompiledLoader : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testLoadFromBundle_data();
+    void testLoadFromBundle();
+
+    void testSmartTrimMismatch();
+    void testInvalidBundle();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+void TestPrecompiledLoader::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+}
+
+void TestPrecompiledLoader::testLoadFromBundle_data()
+{
+    QTest::addColumn<QString>("input");
+    QTest::addColumn<bool>("smartTrim");
+    QTest::addColumn<Dict>("dict");
+
+    Dict dict;
+    dict.insert(QStringLiteral("name"), QStringLiteral("Alice"));
+    dict.insert(QStringLiteral("list"), QVariantList{1, 2, 3});
+
+    QTest::newRow("text") << QStringLiteral("Just text") << false << dict;
+    QTest::newRow("variable") << QStringLiteral("Hello {{ name|upper }}!") << false << dict;
+    QTest::newRow("tags") << QStringLiteral("{% for i in list %}{{ i }}{# comment #},{% endfor %}") << false << dict;
+    QTest::newRow("smarttrim") << QStringLiteral("<ul>\n  {% for i in list %}\n  <li>{{ i }}</li>\n  {% endfor %}\n</ul>\n") << true << dict;
+    QTest::newRow("repeated") << QStringLiteral("name{{ name }}name {{name}}{% if name %}if name{% endif %}") << false << dict;
+    QTest::newRow("include") << QStringLiteral("[{% include \"text\" %}]") << false << dict;
+}
+
+void TestPrecompiledLoader::testLoadFromBundle()
+{
+    QFETCH(QString, input);
+    QFETCH(bool, smartTrim);
+    QFETCH(Dict, dict);
+
+    const auto fileName = m_dir.filePath(QLatin1String(QTest::currentDataTag()) + QStringLiteral(".ktc"));
+    QString errorString;
+    QVERIFY2(PrecompiledTemplateLoader::writeBundle(fileName,
+                                                    {{QStringLiteral("main"), input}, {QStringLiteral("text"), QStringLiteral("Just text")}},
+                                                    smartTrim,
+                                                    &errorString),
+             qPrintable(errorString));
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+    engine.setSmartTrimEnabled(smartTrim);
+
+    auto loader = QSharedPointer<PrecompiledTemplateLoader>::create();
+    QVERIFY2(loader->addBundle(fileName, &errorString), qPrintable(errorString));
+    QCOMPARE(loader->bundles(), QStringList{fileName});
+    engine.addTemplateLoader(loader);
+
+    QVERIFY(loader->canLoadTemplate(QStringLiteral("main")));
+    QVERIFY(!loader->canLoadTemplate(QStringLiteral("missing")));
+
+    const auto t = engine.loadByName(QStringLiteral("main"));
+    QCOMPARE(t->error(), NoError);
+    const auto reference = engine.newTemplate(input, QStringLiteral("reference"));
+
+    Context context(dict);
+    QCOMPARE(t->render(&context), reference->render(&context));
+
+    // Templates loaded from a bundle can be edited.
+    t->applyEdit(0, 0, QStringLiteral("x"));
+    QCOMPARE(t->error(), NoError);
+    QCOMPARE(t->render(&context), QStringLiteral("x") + reference->render(&context));
+}
+
+void TestPrecompiledLoader::testSmartTrimMismatch()
+{
+    const auto fileName = m_dir.filePath(QStringLiteral("mismatch.ktc"));
+    QVERIFY(PrecompiledTemplateLoader::writeBundle(fileName, {{QStringLiteral("main"), QStringLiteral("Text")}}, true));
+
+    Engine engine;
+    engine.setPluginPaths({QStringLiteral(KTEXTTEMPLATE_PLUGIN_PATH)});
+
+    auto loader = QSharedPointer<PrecompiledTemplateLoader>::create();
+    QVERIFY(loader->addBundle(fileName));
+    engine.addTemplateLoader(loader);
+
+    QCOMPARE(engine.loadByName(QStringLiteral("main"))->error(), TagSyntaxError);
+
+    engine.setSmartTrimEnabled(true);
+    QCOMPARE(engine.loadByName(QStringLiteral("main"))->error(), NoError);
+}
+
+void TestPrecompiledLoader::testInvalidBundle()
+{
+    const auto fileName = m_dir.filePath(QStringLiteral("invalid.ktc"));
+    QVERIFY(PrecompiledTemplateLoader::writeBundle(fileName, {{QStringLiteral("main"), QStringLiteral("{{ a }}{{ b }}")}}));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 2));
+    file.close();
+
+    PrecompiledTemplateLoader loader;
+    QString errorString;
+    QVERIFY(!loader.addBundle(fileName, &errorString));
+    QVERIFY(!errorString.isEmpty());
+    QVERIFY(!loader.addBundle(m_dir.filePath(QStringLiteral("missing.ktc"))));
+    QVERIFY(loader.bundles().isEmpty());
+
+    QVERIFY(!PrecompiledTemplateLoader::writeBundle(m_dir.filePath(QStringLiteral("missing/invalid.ktc")), {}, false, &errorString));
+    QVERIFY(errorString.contains(QStringLiteral("missing/invalid.ktc")));
+}
+
+QTEST_MAIN(TestPrecompiledLoader)
+#include "testprecompiledloader.moc"
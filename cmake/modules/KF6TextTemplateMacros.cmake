@@ -14,3 +14,70 @@ macro(ktexttemplate_adjust_plugin_name pluginname)
       )
   endforeach()
 endmacro()
+
+# ktexttemplate_compile_templates(<target>
+#   OUTPUT <bundle>
+#   TEMPLATE_DIRS <dir> [<dir> ...]
+#   [SMART_TRIM]
+#   [PLUGIN_DIRS <dir> [<dir> ...]]
+#   [LIBRARIES <name> [<name> ...]]
+#   [FILTERS <pattern> [<pattern> ...]]
+# )
+#
+# Adds the custom target <target>, built by default, which validates the
+# templates in TEMPLATE_DIRS with ktexttemplate-compile and writes them to the
+# precompiled template bundle OUTPUT, to be loaded with a
+# KTextTemplate::PrecompiledTemplateLoader. Unknown tags or filters and
+# unclosed blocks fail the build.
+#
+# SMART_TRIM must match the smartTrimEnabled setting of the engines loading
+# the bundle. PLUGIN_DIRS are searched for tag and filter plugins in addition
+# to the default plugin directories, and LIBRARIES are available to all
+# templates in addition to the default libraries.
+#
+# Only the files matching the wildcard FILTERS are compiled, so that media in
+# the same directories is left out. By default these are the template suffixes
+# of KTextTemplate::FileSystemTemplateLoader::defaultTemplateNameFilters().
+function(ktexttemplate_compile_templates target)
+  cmake_parse_arguments(ARG "SMART_TRIM" "OUTPUT" "TEMPLATE_DIRS;PLUGIN_DIRS;LIBRARIES;FILTERS" ${ARGN})
+  if (NOT ARG_OUTPUT OR NOT ARG_TEMPLATE_DIRS)
+    message(FATAL_ERROR "ktexttemplate_compile_templates: OUTPUT and TEMPLATE_DIRS are required")
+  endif()
+
+  get_filename_component(_output "${ARG_OUTPUT}" ABSOLUTE BASE_DIR "${CMAKE_CURRENT_BINARY_DIR}")
+
+  set(_args)
+  set(_templates)
+  if (ARG_SMART_TRIM)
+    list(APPEND _args --smart-trim)
+  endif()
+  foreach(_dir ${ARG_PLUGIN_DIRS})
+    list(APPEND _args --plugin-path "${_dir}")
+  endforeach()
+  foreach(_library ${ARG_LIBRARIES})
+    list(APPEND _args --library "${_library}")
+  endforeach()
+  set(_filters ${ARG_FILTERS})
+  if (NOT _filters)
+    set(_filters *.html *.htm *.xhtml *.xml *.txt *.tmpl *.tpl)
+  endif()
+  foreach(_filter ${_filters})
+    list(APPEND _args --filter "${_filter}")
+  endforeach()
+  foreach(_dir ${ARG_TEMPLATE_DIRS})
+    get_filename_component(_dir "${_dir}" ABSOLUTE)
+    foreach(_filter ${_filters})
+      file(GLOB_RECURSE _dir_templates CONFIGURE_DEPENDS "${_dir}/${_filter}")
+      list(APPEND _templates ${_dir_templates})
+    endforeach()
+    list(APPEND _args "${_dir}")
+  endforeach()
+
+  add_custom_command(OUTPUT "${_output}"
+    COMMAND KF6::ktexttemplate-compile -o "${_output}" ${_args}
+    DEPENDS ${_templates}
+    COMMENT "Compiling templates into ${ARG_OUTPUT}"
+    VERBATIM
+  )
+  add_custom_target(${target} ALL DEPENDS "${_output}")
+endfunction()
@@ -0,0 +1,135 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include "engine.h"
+#include "template.h"
+#include "templateloader.h"
+
+#include <ktexttemplate_version.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace KTextTemplate;
+
+static void printError(const QString &message)
+{
+    std::fprintf(stderr, "%s\n", qPrintable(message));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ktexttemplate-compile"));
+    QCoreApplication::setApplicationVersion(QStringLiteral(KTEXTTEMPLATE_VERSION_STRING));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Validates the templates in the given directories and writes them to a precompiled template bundle."));
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    const QCommandLineOption outputOption({QStringLiteral("o"), QStringLiteral("output")}, QStringLiteral("Write the bundle to <file>."), QStringLiteral("file"));
+    const QCommandLineOption smartTrimOption(QStringLiteral("smart-trim"), QStringLiteral("Tokenize the templates for engines with smart trimming enabled."));
+    const QCommandLineOption pluginPathOption(QStringLiteral("plugin-path"),
+                                              QStringLiteral("Also search <dir> for tag and filter plugins. May be given several times."),
+                                              QStringLiteral("dir"));
+    const QCommandLineOption libraryOption(QStringLiteral("library"),
+                                           QStringLiteral("Make the library <name> available to all templates. May be given several times."),
+                                           QStringLiteral("name"));
+    const QCommandLineOption noValidateOption(QStringLiteral("no-validate"), QStringLiteral("Write the bundle without checking the tags and filters used."));
+    const QCommandLineOption filterOption(QStringLiteral("filter"),
+                                          QStringLiteral("Only compile the files whose names match the wildcard <pattern>. May be given several times. "
+                                                         "Defaults to the patterns of FileSystemTemplateLoader::defaultTemplateNameFilters()."),
+                                          QStringLiteral("pattern"));
+    parser.addOptions({outputOption, smartTrimOption, pluginPathOption, libraryOption, noValidateOption, filterOption});
+    parser.addPositionalArgument(QStringLiteral("directories"),
+                                 QStringLiteral("The directories containing the templates. Templates are named by their path relative to the directory."),
+                                 QStringLiteral("<directory>..."));
+    parser.process(app);
+
+    const auto directories = parser.positionalArguments();
+    if (directories.isEmpty() || !parser.isSet(outputOption)) {
+        printError(QStringLiteral("An output file and at least one template directory are required."));
+        parser.showHelp(1);
+    }
+
+    // Other files, such as style sheets and images, are media.
+    auto nameFilters = parser.values(filterOption);
+    if (nameFilters.isEmpty())
+        nameFilters = FileSystemTemplateLoader::defaultTemplateNameFilters();
+
+    auto failed = false;
+
+    // As with a FileSystemTemplateLoader, templates in earlier directories
+    // take precedence.
+    QHash<QString, QString> templates;
+    for (const auto &directory : directories) {
+        const QDir dir(directory);
+        QDirIterator it(directory, nameFilters, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const auto path = it.next();
+            const auto name = dir.relativeFilePath(path);
+            if (templates.contains(name))
+                continue;
+
+            QFile file(path);
+            if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                printError(QStringLiteral("%1: %2").arg(path, file.errorString()));
+                failed = true;
+                continue;
+            }
+            QTextStream stream(&file);
+            stream.setEncoding(QStringConverter::Utf8);
+            templates.insert(name, stream.readAll());
+        }
+    }
+
+    if (!parser.isSet(noValidateOption)) {
+        Engine engine;
+        const auto pluginPaths = parser.values(pluginPathOption);
+        for (const auto &pluginPath : pluginPaths)
+            engine.addPluginPath(pluginPath);
+        const auto libraries = parser.values(libraryOption);
+        for (const auto &library : libraries)
+            engine.addDefaultLibrary(library);
+        engine.setSmartTrimEnabled(parser.isSet(smartTrimOption));
+
+        // Templates loaded by {% extends %} and {% include %} are found in the
+        // same directories.
+        auto loader = QSharedPointer<FileSystemTemplateLoader>::create();
+        loader->setTemplateDirs(directories);
+        engine.addTemplateLoader(loader);
+
+        auto names = templates.keys();
+        std::sort(names.begin(), names.end());
+        for (const auto &name : std::as_const(names)) {
+            const auto t = engine.newTemplate(templates.value(name), name);
+            if (t->error() != NoError) {
+                printError(QStringLiteral("%1: %2").arg(name, t->errorString()));
+                failed = true;
+            }
+        }
+    }
+
+    if (failed)
+        return 1;
+
+    QString errorString;
+    if (!PrecompiledTemplateLoader::writeBundle(parser.value(outputOption), templates, parser.isSet(smartTrimOption), &errorString)) {
+        printError(errorString);
+        return 1;
+    }
+    return 0;
+}
@@ -10,6 +10,7 @@
 #include "ifchanged.h"
 
 #include "parser.h"
+#include "rendercontext.h"
 
 #include <QDateTime>
 
@@ -39,7 +40,6 @@ IfChangedNode::IfChangedNode(const QList<FilterExpression> &feList, QObject *par
     : Node(parent)
     , m_filterExpressions(feList)
 {
-    m_lastSeen = QVariant();
     m_id = QString::number(reinterpret_cast<qint64>(this));
 }
 
@@ -55,8 +55,14 @@ void IfChangedNode::setFalseList(const NodeList &falseList)
 
 void IfChangedNode::render(OutputStream *stream, Context *c) const
 {
+    // The last seen value is state of the render, not of the node, which may
+    // be rendered by several threads at once. It is copied, as rendering the
+    // nodes below may add data to the RenderContext.
+    auto lastSeen = c->renderContext()->data(this);
+
     if (c->lookup(QStringLiteral("forloop")).isValid() && (!c->lookup(QStringLiteral("forloop")).value<QVariantHash>().contains(m_id))) {
-        m_lastSeen = QVariant();
+        lastSeen = QVariant();
+        c->renderContext()->data(this) = lastSeen;
         auto hash = c->lookup(QStringLiteral("forloop")).value<QVariantHash>();
         hash.insert(m_id, 1);
         c->insert(QStringLiteral("forloop"), hash);
@@ -82,18 +88,19 @@ void IfChangedNode::render(OutputStream *stream, Context *c) const
     // to a QList(QVariant(QChar, c)...).
     // Avoid that conversion
     QVariantList lastSeenVarList;
-    if (m_lastSeen.userType() != qMetaTypeId<QString>())
-        lastSeenVarList = m_lastSeen.value<QVariantList>();
+    if (lastSeen.userType() != qMetaTypeId<QString>())
+        lastSeenVarList = lastSeen.value<QVariantList>();
 
     // At first glance it looks like m_last_seen will always be invalid,
     // But it will change because render is called multiple times by the parent
     // {% for %} loop in the template.
-    if ((watchedVars != lastSeenVarList) || (!watchedString.isEmpty() && (watchedString != m_lastSeen.value<QString>()))) {
-        auto firstLoop = !m_lastSeen.isValid();
+    if ((watchedVars != lastSeenVarList) || (!watchedString.isEmpty() && (watchedString != lastSeen.value<QString>()))) {
+        auto firstLoop = !lastSeen.isValid();
         if (!watchedString.isEmpty())
-            m_lastSeen = watchedString;
+            lastSeen = watchedString;
         else
-            m_lastSeen = watchedVars;
+            lastSeen = watchedVars;
+        c->renderContext()->data(this) = lastSeen;
         c->push();
         QVariantHash hash;
         // TODO: Document this.
@@ -38,7 +38,6 @@ private:
     NodeList m_trueList;
     NodeList m_falseList;
     QList<FilterExpression> m_filterExpressions;
-    mutable QVariant m_lastSeen;
     QString m_id;
 };
 
@@ -9,6 +9,20 @@
 
 #include "cachingloaderdecorator.h"
 
+#include "template_p.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QSet>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+
 namespace KTextTemplate
 {
 
@@ -18,20 +32,181 @@ public:
     CachingLoaderDecoratorPrivate(QSharedPointer<AbstractTemplateLoader> loader, CachingLoaderDecorator *qq)
         : q_ptr(qq)
         , m_wrappedLoader(loader)
+        , m_fileSystemLoader(loader.dynamicCast<FileSystemTemplateLoader>())
     {
+        static std::atomic<quint64> s_nextId = 0;
+        m_id = s_nextId++;
+        m_timer.start();
     }
 
     Q_DECLARE_PUBLIC(CachingLoaderDecorator)
     CachingLoaderDecorator *const q_ptr;
 
+    // What is known about the file of a template when it was loaded.
+    struct FileState {
+        QDateTime lastModified;
+        qint64 size = -1;
+        QByteArray hash;
+
+        bool operator==(const FileState &other) const
+        {
+            return lastModified == other.lastModified && size == other.size && hash == other.hash;
+        }
+    };
+
+    // Entries are not modified once they are cached, except for the
+    // bookkeeping which may be updated without the lock.
+    struct Entry {
+        Template t;
+        qint64 cost = 0;
+        // The files of the template and of the templates it loaded while it
+        // was compiled, for staleness checks.
+        QHash<QString, FileState> files;
+
+        // Nanoseconds since the decorator was created.
+        std::atomic<qint64> lastUse = 0;
+        std::atomic<quint64> useCount = 1;
+        // Milliseconds since the decorator was created.
+        std::atomic<qint64> lastCheck = 0;
+    };
+    using EntryPointer = QSharedPointer<Entry>;
+
+    static qint64 costOf(const Template &t);
+    void touch(Entry &entry) const;
+    bool needsCheck(const Entry &entry) const;
+    void evict(const QString &keep) const;
+    void remove(QHash<QString, EntryPointer>::iterator it) const;
+    void removeAll() const;
+    EntryPointer threadEntry(const QString &name) const;
+    void rememberEntry(const QString &name, const EntryPointer &entry) const;
+    FileState fileState(const QString &name) const;
+    bool isStale(const QHash<QString, FileState> &files) const;
+
     const QSharedPointer<AbstractTemplateLoader> m_wrappedLoader;
+    const QSharedPointer<FileSystemTemplateLoader> m_fileSystemLoader;
+    // Identifies the decorator in the caches of the threads.
+    quint64 m_id;
+    // Changed when the cache is cleared, so that the threads drop what they
+    // looked up before.
+    mutable std::atomic<quint64> m_generation = 0;
+
+    // Guards the cache and the templates being loaded. Lookups of cached
+    // templates go through the cache of each thread instead, which only
+    // holds weak references, so that removing an entry here removes it from
+    // all threads.
+    mutable QMutex m_mutex;
+    mutable QHash<QString, EntryPointer> m_cache;
+    mutable qint64 m_cost = 0;
+
+    // Templates being loaded by a thread. Other threads wait for them rather
+    // than compiling them again.
+    mutable QSet<QString> m_loading;
+    mutable QWaitCondition m_loaded;
 
-    mutable QHash<QString, Template> m_cache;
+    int m_maximumSize = 0;
+    qint64 m_maximumCost = 0;
+    std::atomic<CachingLoaderDecorator::EvictionPolicy> m_policy = CachingLoaderDecorator::LeastRecentlyUsed;
+
+    mutable std::atomic<quint64> m_hits = 0;
+    mutable quint64 m_misses = 0;
+    mutable quint64 m_evictions = 0;
+
+    std::atomic<CachingLoaderDecorator::StalenessCheck> m_stalenessCheck = CachingLoaderDecorator::NoStalenessCheck;
+    std::atomic<int> m_stalenessCheckInterval = 0;
+    QElapsedTimer m_timer;
 };
 }
 
 using namespace KTextTemplate;
 
+namespace
+{
+// The templates being compiled by this thread, innermost last, with the
+// templates they load meanwhile.
+struct LoadFrame {
+    const CachingLoaderDecoratorPrivate *cache;
+    QStringList dependencies;
+};
+thread_local QList<LoadFrame> s_loadStack;
+
+struct LoadFrameGuard {
+    LoadFrameGuard(const CachingLoaderDecoratorPrivate *cache)
+    {
+        s_loadStack.append({cache, {}});
+    }
+    ~LoadFrameGuard()
+    {
+        s_loadStack.removeLast();
+    }
+    QStringList dependencies() const
+    {
+        return s_loadStack.last().dependencies;
+    }
+};
+
+// Returns whether the thread is compiling a template loaded from cache.
+bool recordDependency(const CachingLoaderDecoratorPrivate *cache, const QString &name)
+{
+    for (auto it = s_loadStack.rbegin(); it != s_loadStack.rend(); ++it) {
+        if (it->cache == cache) {
+            it->dependencies.append(name);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The entries a decorator handed out to this thread.
+struct ThreadCache {
+    quint64 generation = 0;
+    QHash<QString, QWeakPointer<CachingLoaderDecoratorPrivate::Entry>> entries;
+    // The number of entries after expired ones were last dropped.
+    qsizetype liveEntries = 0;
+};
+
+// The caches of this thread, by decorator id.
+thread_local QHash<quint64, ThreadCache> s_threadCaches;
+
+// The number of decorators destroyed, so that the threads drop their caches.
+std::atomic<quint64> s_destroyedDecorators = 0;
+thread_local quint64 s_threadDestroyedDecorators = 0;
+
+void dropExpiredEntries(ThreadCache &cache)
+{
+    for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+        if (it->isNull())
+            it = cache.entries.erase(it);
+        else
+            ++it;
+    }
+    cache.liveEntries = cache.entries.size();
+}
+
+// Returns the cache of this thread for the decorator id.
+ThreadCache &threadCache(quint64 id, quint64 generation)
+{
+    // The entries of destroyed decorators have all expired.
+    if (const auto destroyed = s_destroyedDecorators.load(std::memory_order_relaxed); destroyed != s_threadDestroyedDecorators) {
+        s_threadDestroyedDecorators = destroyed;
+        for (auto it = s_threadCaches.begin(); it != s_threadCaches.end();) {
+            dropExpiredEntries(*it);
+            if (it->entries.isEmpty())
+                it = s_threadCaches.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    auto &cache = s_threadCaches[id];
+    if (cache.generation != generation) {
+        cache.entries.clear();
+        cache.liveEntries = 0;
+        cache.generation = generation;
+    }
+    return cache;
+}
+}
+
 CachingLoaderDecorator::CachingLoaderDecorator(QSharedPointer<AbstractTemplateLoader> loader)
     : d_ptr(new CachingLoaderDecoratorPrivate(loader, this))
 {
@@ -40,6 +215,7 @@ CachingLoaderDecorator::CachingLoaderDecorator(QSharedPointer<AbstractTemplateLo
 CachingLoaderDecorator::~CachingLoaderDecorator()
 {
     delete d_ptr;
+    s_destroyedDecorators.fetch_add(1, std::memory_order_relaxed);
 }
 
 bool CachingLoaderDecorator::canLoadTemplate(const QString &name) const
@@ -51,18 +227,58 @@ bool CachingLoaderDecorator::canLoadTemplate(const QString &name) const
 void CachingLoaderDecorator::clear()
 {
     Q_D(CachingLoaderDecorator);
-    return d->m_cache.clear();
+    const QMutexLocker locker(&d->m_mutex);
+    d->removeAll();
+}
+
+void CachingLoaderDecorator::invalidate(const QString &name)
+{
+    Q_D(CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    for (auto it = d->m_cache.begin(); it != d->m_cache.end();) {
+        if (it.key() == name || (*it)->files.contains(name)) {
+            d->m_cost -= (*it)->cost;
+            it = d->m_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CachingLoaderDecorator::setStalenessCheck(StalenessCheck check, int interval)
+{
+    Q_D(CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    // Cached templates have no file state to compare against.
+    if (check != d->m_stalenessCheck)
+        d->removeAll();
+    d->m_stalenessCheck = check;
+    d->m_stalenessCheckInterval = interval;
+}
+
+CachingLoaderDecorator::StalenessCheck CachingLoaderDecorator::stalenessCheck() const
+{
+    Q_D(const CachingLoaderDecorator);
+    return d->m_stalenessCheck;
+}
+
+int CachingLoaderDecorator::stalenessCheckInterval() const
+{
+    Q_D(const CachingLoaderDecorator);
+    return d->m_stalenessCheckInterval;
 }
 
 int CachingLoaderDecorator::size() const
 {
     Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
     return d->m_cache.size();
 }
 
 bool CachingLoaderDecorator::isEmpty() const
 {
     Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
     return d->m_cache.isEmpty();
 }
 
@@ -72,17 +288,336 @@ std::pair<QString, QString> CachingLoaderDecorator::getMediaUri(const QString &f
     return d->m_wrappedLoader->getMediaUri(fileName);
 }
 
+void CachingLoaderDecorator::setMaximumSize(int size)
+{
+    Q_D(CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    d->m_maximumSize = size;
+    d->evict({});
+}
+
+int CachingLoaderDecorator::maximumSize() const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    return d->m_maximumSize;
+}
+
+void CachingLoaderDecorator::setMaximumCost(qint64 cost)
+{
+    Q_D(CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    d->m_maximumCost = cost;
+    d->evict({});
+}
+
+qint64 CachingLoaderDecorator::maximumCost() const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    return d->m_maximumCost;
+}
+
+qint64 CachingLoaderDecorator::cost() const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    return d->m_cost;
+}
+
+void CachingLoaderDecorator::setEvictionPolicy(EvictionPolicy policy)
+{
+    Q_D(CachingLoaderDecorator);
+    d->m_policy = policy;
+}
+
+CachingLoaderDecorator::EvictionPolicy CachingLoaderDecorator::evictionPolicy() const
+{
+    Q_D(const CachingLoaderDecorator);
+    return d->m_policy;
+}
+
+quint64 CachingLoaderDecorator::hits() const
+{
+    Q_D(const CachingLoaderDecorator);
+    return d->m_hits.load(std::memory_order_relaxed);
+}
+
+quint64 CachingLoaderDecorator::misses() const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    return d->m_misses;
+}
+
+quint64 CachingLoaderDecorator::evictions() const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    return d->m_evictions;
+}
+
+void CachingLoaderDecorator::resetStatistics()
+{
+    Q_D(CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    d->m_hits = 0;
+    d->m_misses = 0;
+    d->m_evictions = 0;
+}
+
+qint64 CachingLoaderDecoratorPrivate::costOf(const Template &t)
+{
+    return t ? t->d_func()->approximateSize() : 0;
+}
+
+void CachingLoaderDecoratorPrivate::touch(Entry &entry) const
+{
+    // Storing the time of every use would make all threads write to the
+    // entries of popular templates. A millisecond is precise enough to find
+    // the least recently used one.
+    const auto now = m_timer.nsecsElapsed();
+    if (now - entry.lastUse.load(std::memory_order_relaxed) > 1000000)
+        entry.lastUse.store(now, std::memory_order_relaxed);
+    if (m_policy == CachingLoaderDecorator::LeastFrequentlyUsed)
+        entry.useCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool CachingLoaderDecoratorPrivate::needsCheck(const Entry &entry) const
+{
+    return m_stalenessCheck != CachingLoaderDecorator::NoStalenessCheck && m_fileSystemLoader
+        && m_timer.elapsed() - entry.lastCheck.load(std::memory_order_relaxed) >= m_stalenessCheckInterval;
+}
+
+void CachingLoaderDecoratorPrivate::remove(QHash<QString, EntryPointer>::iterator it) const
+{
+    m_cost -= (*it)->cost;
+    m_cache.erase(it);
+}
+
+void CachingLoaderDecoratorPrivate::removeAll() const
+{
+    m_cache.clear();
+    m_cost = 0;
+    m_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+CachingLoaderDecoratorPrivate::EntryPointer CachingLoaderDecoratorPrivate::threadEntry(const QString &name) const
+{
+    auto &cache = threadCache(m_id, m_generation.load(std::memory_order_relaxed));
+    const auto it = cache.entries.find(name);
+    if (it == cache.entries.end())
+        return {};
+    auto entry = it->toStrongRef();
+    // Evicted or invalidated meanwhile.
+    if (!entry)
+        cache.entries.erase(it);
+    return entry;
+}
+
+void CachingLoaderDecoratorPrivate::rememberEntry(const QString &name, const EntryPointer &entry) const
+{
+    auto &cache = threadCache(m_id, m_generation.load(std::memory_order_relaxed));
+    cache.entries.insert(name, entry);
+    // Entries which are never looked up again are dropped once the cache has
+    // grown to twice its live size, which keeps it bounded by the size of
+    // the decorator at a constant cost per insertion.
+    if (cache.entries.size() > 2 * std::max<qsizetype>(cache.liveEntries, 16))
+        dropExpiredEntries(cache);
+}
+
+CachingLoaderDecoratorPrivate::FileState CachingLoaderDecoratorPrivate::fileState(const QString &name) const
+{
+    FileState state;
+    const auto fileName = m_fileSystemLoader->templateFileName(name);
+    if (fileName.isEmpty())
+        return state;
+
+    if (m_stalenessCheck == CachingLoaderDecorator::CheckContentHash) {
+        QFile file(fileName);
+        if (file.open(QIODevice::ReadOnly)) {
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            hash.addData(&file);
+            state.hash = hash.result();
+        }
+    } else {
+        const QFileInfo fileInfo(fileName);
+        state.lastModified = fileInfo.lastModified();
+        state.size = fileInfo.size();
+    }
+    return state;
+}
+
+bool CachingLoaderDecoratorPrivate::isStale(const QHash<QString, FileState> &files) const
+{
+    for (auto it = files.cbegin(); it != files.cend(); ++it) {
+        if (!(fileState(it.key()) == it.value()))
+            return true;
+    }
+    return false;
+}
+
+void CachingLoaderDecoratorPrivate::evict(const QString &keep) const
+{
+    const auto isFull = [this] {
+        return (m_maximumSize > 0 && m_cache.size() > m_maximumSize) || (m_maximumCost > 0 && m_cost > m_maximumCost);
+    };
+
+    // Evictions only happen when a template was compiled, which costs far more
+    // than scanning the entries, so there is no separate ordering of them to
+    // maintain on each hit.
+    while (isFull()) {
+        auto victim = m_cache.end();
+        for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+            if (it.key() == keep)
+                continue;
+            if (victim == m_cache.end()) {
+                victim = it;
+                continue;
+            }
+            const auto &entry = **it;
+            const auto &victimEntry = **victim;
+            if (m_policy == CachingLoaderDecorator::LeastFrequentlyUsed) {
+                if (entry.useCount < victimEntry.useCount || (entry.useCount == victimEntry.useCount && entry.lastUse < victimEntry.lastUse))
+                    victim = it;
+            } else if (entry.lastUse < victimEntry.lastUse) {
+                victim = it;
+            }
+        }
+        if (victim == m_cache.end())
+            return;
+        remove(victim);
+        ++m_evictions;
+    }
+}
+
 Template CachingLoaderDecorator::loadByName(const QString &name, const KTextTemplate::Engine *engine) const
 {
     Q_D(const CachingLoaderDecorator);
-    const auto it = d->m_cache.constFind(name);
-    if (it != d->m_cache.constEnd()) {
-        return it.value();
+    const auto nested = recordDependency(d, name);
+
+    // Lock-free path: the thread already used the template, and it is still
+    // cached.
+    if (const auto entry = d->threadEntry(name); entry && !d->needsCheck(*entry)) {
+        d->touch(*entry);
+        d->m_hits.fetch_add(1, std::memory_order_relaxed);
+        return entry->t;
+    }
+
+    QMutexLocker locker(&d->m_mutex);
+    for (;;) {
+        const auto it = d->m_cache.find(name);
+        if (it != d->m_cache.end()) {
+            const auto entry = *it;
+            auto stale = false;
+            if (d->needsCheck(*entry)) {
+                // The files are checked without the lock, which would
+                // otherwise make all loads wait for the disk.
+                entry->lastCheck = d->m_timer.elapsed();
+                const auto files = entry->files;
+                locker.unlock();
+                stale = d->isStale(files);
+                locker.relock();
+            }
+            if (!stale) {
+                d->touch(*entry);
+                d->m_hits.fetch_add(1, std::memory_order_relaxed);
+                d->rememberEntry(name, entry);
+                return entry->t;
+            }
+            // Unless another thread replaced it meanwhile.
+            if (const auto current = d->m_cache.find(name); current != d->m_cache.end() && *current == entry)
+                d->remove(current);
+            continue;
+        }
+        // Wait for another thread loading the same template, unless this
+        // thread is loading templates itself, which that thread might be
+        // waiting for.
+        if (nested || !d->m_loading.contains(name))
+            break;
+        d->m_loaded.wait(&d->m_mutex);
     }
+    ++d->m_misses;
+    const auto checkFiles = d->m_stalenessCheck != NoStalenessCheck && d->m_fileSystemLoader;
+    const auto loading = !d->m_loading.contains(name);
+    if (loading)
+        d->m_loading.insert(name);
+    locker.unlock();
 
-    const auto t = d->m_wrappedLoader->loadByName(name, engine);
+    // The state of the file is taken before loading it, so that a change
+    // while loading is found by the next check.
+    QHash<QString, CachingLoaderDecoratorPrivate::FileState> files;
+    if (checkFiles)
+        files.insert(name, d->fileState(name));
 
-    d->m_cache.insert(name, t);
+    // The lock is not held while loading, which may load further templates
+    // through the Engine.
+    const auto finishLoading = [&] {
+        locker.relock();
+        if (loading) {
+            d->m_loading.remove(name);
+            d->m_loaded.wakeAll();
+        }
+    };
+    Template t;
+    QStringList dependencies;
+    try {
+        const LoadFrameGuard frame(d);
+        t = d->m_wrappedLoader->loadByName(name, engine);
+        dependencies = frame.dependencies();
+    } catch (...) {
+        finishLoading();
+        throw;
+    }
+    const auto cost = CachingLoaderDecoratorPrivate::costOf(t);
+
+    // A template compiled with another one is stale when that one is, and is
+    // invalidated with it, which includes the templates that one was
+    // compiled with.
+    QStringList uncachedDependencies;
+    locker.relock();
+    for (const auto &dependency : std::as_const(dependencies)) {
+        if (!checkFiles)
+            files.insert(dependency, {});
+        const auto dependencyIt = d->m_cache.constFind(dependency);
+        if (dependencyIt != d->m_cache.constEnd())
+            files.insert((*dependencyIt)->files);
+        else if (checkFiles)
+            uncachedDependencies.append(dependency);
+    }
+    locker.unlock();
+    for (const auto &dependency : std::as_const(uncachedDependencies))
+        files.insert(dependency, d->fileState(dependency));
 
-    return t;
+    finishLoading();
+
+    // A nested load may have loaded the same template meanwhile.
+    auto entry = d->m_cache.value(name);
+    if (!entry) {
+        entry = CachingLoaderDecoratorPrivate::EntryPointer::create();
+        entry->t = t;
+        entry->cost = cost;
+        entry->files = files;
+        entry->lastUse = d->m_timer.nsecsElapsed();
+        entry->lastCheck = d->m_timer.elapsed();
+        d->m_cache.insert(name, entry);
+        d->m_cost += cost;
+        d->evict(name);
+    }
+    // Not kept from the lookup above, as nested loads through other
+    // decorators may have rehashed the caches of the thread.
+    d->rememberEntry(name, entry);
+    return entry->t;
+}
+
+Template CachingLoaderDecorator::cachedTemplate(const QString &name) const
+{
+    Q_D(const CachingLoaderDecorator);
+    const QMutexLocker locker(&d->m_mutex);
+    const auto entry = d->m_cache.value(name);
+    if (!entry || d->needsCheck(*entry))
+        return {};
+    d->touch(*entry);
+    d->m_hits.fetch_add(1, std::memory_order_relaxed);
+    return entry->t;
 }
@@ -55,10 +55,73 @@ class CachingLoaderDecoratorPrivate;
 
   If the loading of Templates is a bottleneck in an application, it may make
   sense to use the caching decorator.
+
+  The decorator may be used by several threads at once. Loading a Template
+  which the thread loaded before does not lock, and a Template requested by
+  several threads at once is only compiled by one of them.
+
+  By default the cache keeps every Template it loads. Its memory use can be
+  bounded with setMaximumSize and setMaximumCost, in which case Templates
+  are evicted according to the evictionPolicy when a new Template is cached.
+
+  \code
+    cache->setMaximumCost(64 * 1024 * 1024);
+    cache->setEvictionPolicy(KTextTemplate::CachingLoaderDecorator::LeastFrequentlyUsed);
+  \endcode
+
+  Evicting a Template does not affect renders which are using it.
+
+  When decorating a FileSystemTemplateLoader, the cache can check whether the
+  files of cached Templates have changed, and load a Template again if so.
+  A Template which loaded other Templates while it was compiled is also
+  loaded again if one of their files changes.
+
+  \code
+    // Check at most once every two seconds per Template.
+    cache->setStalenessCheck(KTextTemplate::CachingLoaderDecorator::CheckModificationTime, 2000);
+  \endcode
+
+  Applications which watch the files themselves, for example with a
+  QFileSystemWatcher, can call invalidate instead.
  */
 class KTEXTTEMPLATE_EXPORT CachingLoaderDecorator : public AbstractTemplateLoader
 {
 public:
+    /*!
+      \enum KTextTemplate::CachingLoaderDecorator::EvictionPolicy
+
+      Which Template is evicted when the cache is full.
+
+      \value LeastRecentlyUsed
+             The Template which was loaded least recently.
+      \value LeastFrequentlyUsed
+             The Template which was loaded the fewest times.
+    */
+    enum EvictionPolicy {
+        LeastRecentlyUsed,
+        LeastFrequentlyUsed,
+    };
+
+    /*!
+      \enum KTextTemplate::CachingLoaderDecorator::StalenessCheck
+
+      How the cache finds out that the file of a Template has changed.
+
+      \value NoStalenessCheck
+             Cached Templates are used until they are evicted or invalidated.
+      \value CheckModificationTime
+             The modification time and size of the file are compared.
+      \value CheckContentHash
+             A hash of the content of the file is compared. This also finds
+             changes which keep the modification time, at the cost of reading
+             the file.
+    */
+    enum StalenessCheck {
+        NoStalenessCheck,
+        CheckModificationTime,
+        CheckContentHash,
+    };
+
     /*!
       Constructor
     */
@@ -96,7 +159,108 @@ public:
      */
     bool isEmpty() const;
 
+    /*!
+      Sets the maximum number of Templates kept in the cache to \a size.
+
+      A size of 0, the default, does not limit the number of Templates.
+     */
+    void setMaximumSize(int size);
+
+    /*!
+      Returns the maximum number of Templates kept in the cache.
+     */
+    int maximumSize() const;
+
+    /*!
+      Sets the maximum cost of the Templates kept in the cache to \a cost.
+
+      The cost of a Template is an estimate of the bytes used by its source
+      and its compiled nodes. A cost of 0, the default, does not limit the
+      cost of the Templates.
+
+      The most recently loaded Template is kept even if its cost alone
+      exceeds \a cost.
+     */
+    void setMaximumCost(qint64 cost);
+
+    /*!
+      Returns the maximum cost of the Templates kept in the cache.
+     */
+    qint64 maximumCost() const;
+
+    /*!
+      Returns the total cost of the Templates in the cache.
+
+      \sa setMaximumCost
+     */
+    qint64 cost() const;
+
+    /*!
+      Sets the policy used to choose the Template to evict to \a policy.
+
+      The default is LeastRecentlyUsed.
+     */
+    void setEvictionPolicy(EvictionPolicy policy);
+
+    /*!
+      Returns the policy used to choose the Template to evict.
+     */
+    EvictionPolicy evictionPolicy() const;
+
+    /*!
+      Returns the number of loads which returned a cached Template.
+     */
+    quint64 hits() const;
+
+    /*!
+      Returns the number of loads which used the decorated loader.
+     */
+    quint64 misses() const;
+
+    /*!
+      Returns the number of Templates evicted from the cache.
+
+      Templates removed by clear are not counted.
+     */
+    quint64 evictions() const;
+
+    /*!
+      Sets hits, misses and evictions to 0.
+     */
+    void resetStatistics();
+
+    /*!
+      Removes the Template \a name from the cache, together with the Templates
+      which loaded it while they were compiled.
+     */
+    void invalidate(const QString &name);
+
+    /*!
+      Sets how cached Templates are checked for changes to their files to
+      \a check. Each Template is checked when it is loaded, at most once every
+      \a interval milliseconds.
+
+      Checks are only done if the decorated loader is a
+      FileSystemTemplateLoader. Changing the check clears the cache.
+     */
+    void setStalenessCheck(StalenessCheck check, int interval = 0);
+
+    /*!
+      Returns how cached Templates are checked for changes to their files.
+     */
+    StalenessCheck stalenessCheck() const;
+
+    /*!
+      Returns the minimum time in milliseconds between checks of a Template.
+     */
+    int stalenessCheckInterval() const;
+
 private:
+    // Returns the cached Template called name if it is not due for a
+    // staleness check, so that Engine::loadByNameAsync reports it at once.
+    Template cachedTemplate(const QString &name) const;
+    friend class EnginePrivate;
+
     Q_DECLARE_PRIVATE(CachingLoaderDecorator)
     CachingLoaderDecoratorPrivate *const d_ptr;
 };
@@ -11,10 +11,14 @@
 
 #include "nulllocalizer_p.h"
 #include "rendercontext.h"
+#include "symboltable_p.h"
 #include "util.h"
+#include "valuetype_p.h"
 
 #include <QStringList>
 
+#include <optional>
+
 using namespace KTextTemplate;
 
 namespace KTextTemplate
@@ -26,7 +30,9 @@ class ContextPrivate
         , m_renderContext(new RenderContext)
         , m_localizer(new NullLocalizer)
     {
-        m_variantHashStack.append(variantHash);
+        for (auto it = variantHash.constBegin(); it != variantHash.constEnd(); ++it)
+            insertRoot(it.key(), it.value());
+        m_rootHash = variantHash;
     }
 
     ~ContextPrivate()
@@ -34,10 +40,67 @@ class ContextPrivate
         delete m_renderContext;
     }
 
+    struct Value;
+    const Value *find(int symbol, const QString &name) const;
+    void insertRoot(const QString &name, const QVariant &variant);
+    QVariantHash scopeHash(qsizetype frame) const;
+
     Q_DECLARE_PUBLIC(Context)
     Context *const q_ptr;
 
-    QList<QVariantHash> m_variantHashStack;
+    // A value of the context together with what lookups return for it. A
+    // QString inserted into the context is returned as a
+    // KTextTemplate::SafeString, which is converted once here rather than
+    // each time it is looked up. The original value is kept for stackHash,
+    // and the value rendered by Variables is unpacked from its QVariant.
+    struct Value {
+        Value() = default;
+        explicit Value(const QVariant &variant)
+            : value(variant)
+            , lookupValue(variant.userType() == qMetaTypeId<QString>()
+                              ? QVariant::fromValue<KTextTemplate::SafeString>(getSafeString(variant))
+                              : variant)
+            , renderValue(RenderValue::fromVariant(lookupValue))
+        {
+        }
+
+        QVariant value;
+        QVariant lookupValue;
+        RenderValue renderValue;
+    };
+
+    // The outermost scope, which holds the data of the render and is
+    // usually the largest, by the symbols of the names.
+    QHash<int, Value> m_root;
+    // The values whose names no Variable uses, which are not interned, as
+    // the keys of the data may be arbitrary and the symbols are never
+    // released.
+    QHash<QString, Value> m_uninternedRoot;
+    // The values by name, built when stackHash asks for them.
+    mutable std::optional<QVariantHash> m_rootHash;
+
+    // The scopes pushed by tags, which are small and short lived. Their values
+    // are kept one after the other in m_entries, and each frame starts where
+    // the previous one ends. Popping a frame only truncates the entries, so
+    // their storage is reused by the next push rather than allocated for each
+    // scope.
+    struct Entry {
+        // The name is only kept if it is not interned.
+        int symbol;
+        QString name;
+        Value value;
+
+        bool matches(int otherSymbol, const QString &otherName) const
+        {
+            return symbol == SymbolTable::NoSymbol ? name == otherName : symbol == otherSymbol;
+        }
+    };
+    struct Frame {
+        qsizetype begin;
+        mutable std::optional<QVariantHash> hash;
+    };
+    QList<Entry> m_entries;
+    QList<Frame> m_frames;
     bool m_autoescape = true;
     bool m_mutating = false;
     QList<std::pair<QString, QString>> m_externalMedia;
@@ -71,7 +134,12 @@ Context &Context::operator=(const Context &other)
     d_ptr->m_autoescape = other.d_ptr->m_autoescape;
     d_ptr->m_externalMedia = other.d_ptr->m_externalMedia;
     d_ptr->m_mutating = other.d_ptr->m_mutating;
-    d_ptr->m_variantHashStack = other.d_ptr->m_variantHashStack;
+    // The scopes are implicitly shared until either context changes them.
+    d_ptr->m_root = other.d_ptr->m_root;
+    d_ptr->m_uninternedRoot = other.d_ptr->m_uninternedRoot;
+    d_ptr->m_rootHash = other.d_ptr->m_rootHash;
+    d_ptr->m_entries = other.d_ptr->m_entries;
+    d_ptr->m_frames = other.d_ptr->m_frames;
     d_ptr->m_urlType = other.d_ptr->m_urlType;
     d_ptr->m_relativeMediaPath = other.d_ptr->m_relativeMediaPath;
     return *this;
@@ -96,59 +164,140 @@ void Context::setAutoEscape(bool autoescape)
 
 QVariant Context::lookup(const QString &str) const
 {
-    Q_D(const Context);
+    return lookupSymbol(SymbolTable::find(str), str);
+}
 
-    // return a variant from the stack.
-    for (const auto &h : d->m_variantHashStack) {
-        auto it = h.constFind(str);
-        if (it != h.constEnd()) {
-            auto var = it.value();
-            // If the user passed a string into the context, turn it into a
-            // KTextTemplate::SafeString.
-            if (var.userType() == qMetaTypeId<QString>()) {
-                var = QVariant::fromValue<KTextTemplate::SafeString>(getSafeString(var.value<QString>()));
-            }
-            return var;
-        }
+const ContextPrivate::Value *ContextPrivate::find(int symbol, const QString &name) const
+{
+    // The entries of inner scopes come after those of outer ones, and a
+    // name is only once in each scope.
+    for (auto i = m_entries.size() - 1; i >= 0; --i) {
+        const auto &entry = m_entries.at(i);
+        if (entry.matches(symbol, name))
+            return &entry.value;
     }
+    if (symbol != SymbolTable::NoSymbol) {
+        if (const auto it = m_root.constFind(symbol); it != m_root.constEnd())
+            return &it.value();
+    }
+    // The name may have been interned after the value was inserted.
+    if (!m_uninternedRoot.isEmpty()) {
+        if (const auto it = m_uninternedRoot.constFind(name); it != m_uninternedRoot.constEnd())
+            return &it.value();
+    }
+    return nullptr;
+}
 
-    return {};
+QVariant Context::lookupSymbol(int symbol, const QString &name) const
+{
+    Q_D(const Context);
+    const auto value = d->find(symbol, name);
+    return value ? value->lookupValue : QVariant();
+}
+
+RenderValue Context::lookupRenderValue(int symbol, const QString &name) const
+{
+    Q_D(const Context);
+    const auto value = d->find(symbol, name);
+    return value ? value->renderValue : RenderValue();
 }
 
 void Context::push()
 {
     Q_D(Context);
 
-    const QHash<QString, QVariant> hash;
-    d->m_variantHashStack.prepend(hash);
+    d->m_frames.append({d->m_entries.size(), {}});
 }
 
 void Context::pop()
 {
     Q_D(Context);
 
-    d->m_variantHashStack.removeFirst();
+    if (d->m_frames.isEmpty()) {
+        d->m_root.clear();
+        d->m_uninternedRoot.clear();
+        d->m_rootHash.reset();
+        return;
+    }
+    d->m_entries.resize(d->m_frames.last().begin);
+    d->m_frames.removeLast();
+}
+
+void ContextPrivate::insertRoot(const QString &name, const QVariant &variant)
+{
+    const auto symbol = SymbolTable::find(name);
+    if (symbol == SymbolTable::NoSymbol) {
+        m_uninternedRoot.insert(name, Value(variant));
+        return;
+    }
+    m_root.insert(symbol, Value(variant));
+    if (!m_uninternedRoot.isEmpty())
+        m_uninternedRoot.remove(name);
 }
 
 void Context::insert(const QString &name, const QVariant &variant)
 {
     Q_D(Context);
 
-    d->m_variantHashStack[0].insert(name, variant);
+    if (d->m_frames.isEmpty()) {
+        d->insertRoot(name, variant);
+        d->m_rootHash.reset();
+        return;
+    }
+
+    const auto symbol = SymbolTable::find(name);
+    auto &frame = d->m_frames.last();
+    frame.hash.reset();
+    for (auto i = frame.begin; i < d->m_entries.size(); ++i) {
+        auto &entry = d->m_entries[i];
+        if (entry.matches(symbol, name)) {
+            entry = {symbol, symbol == SymbolTable::NoSymbol ? name : QString(), ContextPrivate::Value(variant)};
+            return;
+        }
+    }
+    d->m_entries.append({symbol, symbol == SymbolTable::NoSymbol ? name : QString(), ContextPrivate::Value(variant)});
 }
 
 void Context::insert(const QString &name, QObject *object)
 {
-    Q_D(Context);
+    insert(name, QVariant::fromValue(object));
+}
 
-    d->m_variantHashStack[0].insert(name, QVariant::fromValue(object));
+QVariantHash ContextPrivate::scopeHash(qsizetype frame) const
+{
+    const auto &f = m_frames.at(frame);
+    if (!f.hash) {
+        const auto end = frame + 1 < m_frames.size() ? m_frames.at(frame + 1).begin : m_entries.size();
+        QVariantHash hash;
+        hash.reserve(end - f.begin);
+        for (auto i = f.begin; i < end; ++i) {
+            const auto &entry = m_entries.at(i);
+            hash.insert(entry.symbol == SymbolTable::NoSymbol ? entry.name : SymbolTable::name(entry.symbol), entry.value.value);
+        }
+        f.hash = hash;
+    }
+    return *f.hash;
 }
 
 QHash<QString, QVariant> Context::stackHash(int depth) const
 {
     Q_D(const Context);
 
-    return d->m_variantHashStack.value(depth);
+    if (depth < 0 || depth > d->m_frames.size())
+        return {};
+    if (depth < d->m_frames.size())
+        return d->scopeHash(d->m_frames.size() - 1 - depth);
+
+    if (!d->m_rootHash) {
+        QVariantHash hash;
+        hash.reserve(d->m_root.size() + d->m_uninternedRoot.size());
+        for (auto it = d->m_root.constBegin(); it != d->m_root.constEnd(); ++it)
+            hash.insert(SymbolTable::name(it.key()), it.value().value);
+        for (auto it = d->m_uninternedRoot.constBegin(); it != d->m_uninternedRoot.constEnd(); ++it)
+            hash.insert(it.key(), it.value().value);
+        d->m_rootHash = hash;
+    }
+    return *d->m_rootHash;
 }
 
 bool Context::isMutating() const
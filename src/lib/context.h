@@ -19,6 +19,7 @@ namespace KTextTemplate
 {
 
 class RenderContext;
+class RenderValue;
 
 class ContextPrivate;
 
@@ -249,6 +250,12 @@ public:
     RenderContext *renderContext() const;
 
 private:
+    // Looks up a variable by the interned symbol of its name, or by name for
+    // values whose names were not interned when they were inserted.
+    QVariant lookupSymbol(int symbol, const QString &name) const;
+    KTEXTTEMPLATE_NO_EXPORT RenderValue lookupRenderValue(int symbol, const QString &name) const;
+    friend class Variable;
+
     Q_DECLARE_PRIVATE(Context)
     ContextPrivate *const d_ptr;
 };
@@ -10,14 +10,24 @@
 #include "engine.h"
 #include "engine_p.h"
 
+#include "cachingloaderdecorator.h"
+#include "context.h"
 #include "exception.h"
 #include "ktexttemplate_config_p.h"
 #include "template_p.h"
 
 #include <QCoreApplication>
 #include <QDir>
+#include <QMutex>
 #include <QPluginLoader>
+#include <QPromise>
+#include <QSemaphore>
 #include <QTextStream>
+#include <QThreadPool>
+
+#include <atomic>
+#include <exception>
+#include <memory>
 
 using namespace Qt::Literals;
 using namespace KTextTemplate;
@@ -115,6 +125,7 @@ void Engine::removeDefaultLibrary(const QString &libName)
 void Engine::loadDefaultLibraries()
 {
     Q_D(Engine);
+    const QMutexLocker locker(&d->m_libraryMutex);
 
     // Make sure we can load default scriptable libraries if we're supposed to.
     if (d->m_defaultLibraries.contains(s_scriptableLibName)) {
@@ -154,6 +165,7 @@ void Engine::loadDefaultLibraries()
 TagLibraryInterface *Engine::loadLibrary(const QString &name)
 {
     Q_D(Engine);
+    const QMutexLocker locker(&d->m_libraryMutex);
 
     // already loaded by the engine.
     if (d->m_libraries.contains(name))
@@ -181,6 +193,7 @@ TagLibraryInterface *EnginePrivate::loadLibrary(const QString &name)
 EnginePrivate::EnginePrivate(Engine *engine)
     : q_ptr(engine)
     , m_smartTrimEnabled(false)
+    , m_constantTemplateResolutionEnabled(false)
 {
 }
 
@@ -291,13 +304,90 @@ Template Engine::loadByName(const QString &name) const
             return t;
         }
     }
-    auto t = Template(new TemplateImpl(this));
+    return d->notFoundTemplate(name);
+}
+
+Template EnginePrivate::notFoundTemplate(const QString &name) const
+{
+    Q_Q(const Engine);
+    auto t = Template(new TemplateImpl(q));
     t->setObjectName(name);
-    t->d_ptr->m_error = TagSyntaxError;
-    t->d_ptr->m_errorString = QStringLiteral("Template not found, %1").arg(name);
+    t->d_ptr->setCompileError(TagSyntaxError, QStringLiteral("Template not found, %1").arg(name));
     return t;
 }
 
+// An asynchronous load, which asks each loader in turn.
+struct EnginePrivate::AsyncLoad {
+    const EnginePrivate *d;
+    QString name;
+    QList<QSharedPointer<AbstractTemplateLoader>> loaders;
+    qsizetype next = 0;
+    QThreadPool *pool;
+    QPromise<Template> promise;
+
+    void finish(const Template &t, std::exception_ptr exception = {})
+    {
+        {
+            const QMutexLocker locker(&d->m_pendingLoadsMutex);
+            d->m_pendingLoads.remove(name);
+        }
+        if (exception)
+            promise.setException(exception);
+        else
+            promise.addResult(t);
+        promise.finish();
+    }
+};
+
+// Loads name with loader in a thread of pool, unless the loader has its own
+// way of loading templates asynchronously.
+QFuture<Template> EnginePrivate::loadAsync(const QSharedPointer<AbstractTemplateLoader> &loader, const QString &name, const Engine *engine, QThreadPool *pool)
+{
+    if (const auto asyncLoader = dynamic_cast<const AsyncTemplateLoaderInterface *>(loader.data()))
+        return asyncLoader->loadByNameAsync(name, engine, pool);
+
+    if (const auto cachingLoader = dynamic_cast<const CachingLoaderDecorator *>(loader.data())) {
+        if (const auto t = cachingLoader->cachedTemplate(name))
+            return QtFuture::makeReadyValueFuture(t);
+    }
+
+    const auto promise = std::make_shared<QPromise<Template>>();
+    promise->start();
+    pool->start([loader, promise, name, engine] {
+        try {
+            promise->addResult(loader->canLoadTemplate(name) ? loader->loadByName(name, engine) : Template());
+        } catch (...) {
+            promise->setException(std::current_exception());
+        }
+        promise->finish();
+    });
+    return promise->future();
+}
+
+void EnginePrivate::continueAsyncLoad(const std::shared_ptr<AsyncLoad> &load)
+{
+    if (load->next == load->loaders.size()) {
+        load->finish(load->d->notFoundTemplate(load->name));
+        return;
+    }
+    const auto &loader = load->loaders.at(load->next++);
+    // Continued in the thread which finishes the load, or here if it is
+    // already finished.
+    loadAsync(loader, load->name, load->d->q_ptr, load->pool).then(QtFuture::Launch::Sync, [load](QFuture<Template> future) {
+        Template t;
+        try {
+            t = future.result();
+        } catch (...) {
+            load->finish({}, std::current_exception());
+            return;
+        }
+        if (t)
+            load->finish(t);
+        else
+            continueAsyncLoad(load);
+    });
+}
+
 Template Engine::newTemplate(const QString &content, const QString &name) const
 {
     Q_D(const Engine);
@@ -307,6 +397,123 @@ Template Engine::newTemplate(const QString &content, const QString &name) const
     return t;
 }
 
+QFuture<Template> Engine::loadByNameAsync(const QString &name, QThreadPool *pool) const
+{
+    Q_D(const Engine);
+
+    const auto load = std::make_shared<EnginePrivate::AsyncLoad>();
+    {
+        const QMutexLocker locker(&d->m_pendingLoadsMutex);
+        if (const auto it = d->m_pendingLoads.constFind(name); it != d->m_pendingLoads.constEnd())
+            return *it;
+        load->d = d;
+        load->name = name;
+        load->loaders = d->m_loaders;
+        load->pool = pool ? pool : QThreadPool::globalInstance();
+        load->promise.start();
+        d->m_pendingLoads.insert(name, load->promise.future());
+    }
+    const auto future = load->promise.future();
+    // Outside of the lock, as the load may finish at once.
+    EnginePrivate::continueAsyncLoad(load);
+    return future;
+}
+
+// Calls work for each index in [0, count) in the threads of pool and the
+// calling thread. Each thread takes the next index when it is done with the
+// previous one.
+//
+// If work throws, no further indexes are handed out, and the first exception
+// is rethrown in the calling thread once all the threads are done, as they
+// use the state of this frame.
+static void forEachIndex(qsizetype count, QThreadPool *pool, const std::function<void(qsizetype)> &work)
+{
+    if (!pool)
+        pool = QThreadPool::globalInstance();
+
+    std::atomic<qsizetype> next = 0;
+    QMutex errorMutex;
+    std::exception_ptr error;
+    const auto stop = [&](std::exception_ptr exception) {
+        next = count;
+        const QMutexLocker locker(&errorMutex);
+        if (!error)
+            error = exception;
+    };
+    const auto run = [&] {
+        try {
+            for (auto index = next++; index < count; index = next++)
+                work(index);
+        } catch (...) {
+            stop(std::current_exception());
+        }
+    };
+
+    // Only threads which are idle now are used. Waiting for busy threads could
+    // deadlock if the caller is itself running in the pool.
+    QSemaphore finished;
+    auto started = 0;
+    try {
+        while (started < count - 1
+               && pool->tryStart([&] {
+                      run();
+                      finished.release();
+                  }))
+            ++started;
+    } catch (...) {
+        stop(std::current_exception());
+    }
+    run();
+    finished.acquire(started);
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+QList<Template> Engine::precompile(const QStringList &names, QThreadPool *pool)
+{
+    // Load the plugins once rather than in each thread. Failures are reported
+    // by the templates which use them.
+    try {
+        loadDefaultLibraries();
+    } catch (KTextTemplate::Exception &) {
+    }
+
+    QList<Template> templates(names.size());
+    const auto data = templates.data();
+    forEachIndex(names.size(), pool, [&](qsizetype index) {
+        data[index] = loadByName(names.at(index));
+    });
+    return templates;
+}
+
+QList<RenderResult> Engine::renderBatch(const Template &t, const QList<Context *> &contexts, QThreadPool *pool) const
+{
+    QList<RenderResult> results(contexts.size());
+    // Detach before the threads write to their own elements.
+    const auto data = results.data();
+    forEachIndex(contexts.size(), pool, [&](qsizetype index) {
+        data[index] = t->tryRender(contexts.at(index));
+    });
+    return results;
+}
+
+void Engine::renderBatch(const Template &t,
+                         qsizetype count,
+                         const std::function<void(qsizetype index, Context *context)> &setup,
+                         const std::function<void(qsizetype index, const RenderResult &result)> &resultReady,
+                         QThreadPool *pool) const
+{
+    QMutex mutex;
+    forEachIndex(count, pool, [&](qsizetype index) {
+        Context c;
+        setup(index, &c);
+        const auto result = t->tryRender(&c);
+        const QMutexLocker locker(&mutex);
+        resultReady(index, result);
+    });
+}
+
 void Engine::setSmartTrimEnabled(bool enabled)
 {
     Q_D(Engine);
@@ -319,4 +526,16 @@ bool Engine::smartTrimEnabled() const
     return d->m_smartTrimEnabled;
 }
 
+void Engine::setConstantTemplateResolutionEnabled(bool enabled)
+{
+    Q_D(Engine);
+    d->m_constantTemplateResolutionEnabled = enabled;
+}
+
+bool Engine::constantTemplateResolutionEnabled() const
+{
+    Q_D(const Engine);
+    return d->m_constantTemplateResolutionEnabled;
+}
+
 #include "moc_engine.cpp"
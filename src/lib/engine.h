@@ -13,8 +13,13 @@
 #include "template.h"
 #include "templateloader.h"
 
+#include <functional>
+
+class QThreadPool;
+
 namespace KTextTemplate
 {
+class Context;
 class TagLibraryInterface;
 
 class EnginePrivate;
@@ -173,6 +178,36 @@ public:
     */
     Template loadByName(const QString &name) const;
 
+    /*!
+      Starts loading the Template identified by \a name, and returns a QFuture
+      which reports it when it is loaded and compiled. The loading is done by
+      the threads of \a pool, or of the global QThreadPool if \a pool is null,
+      so an event loop is not blocked on I/O:
+
+      \code
+        engine->loadByNameAsync("page.html").then(this, [this](const Template &t) {
+            Context c;
+            // ...
+            reply(t->render(&c));
+        });
+      \endcode
+
+      Requests for a Template which is still being loaded share the same
+      future. As with loadByName, a Template which could not be loaded or
+      compiled reports an error.
+
+      Each loader is asked in a thread of the pool through
+      AbstractTemplateLoader::canLoadTemplate and
+      AbstractTemplateLoader::loadByName, unless it implements
+      AsyncTemplateLoaderInterface. Templates cached in a
+      CachingLoaderDecorator are reported at once.
+
+      The Engine must not be destroyed while loads are pending.
+
+      \sa AsyncTemplateLoaderInterface
+    */
+    QFuture<Template> loadByNameAsync(const QString &name, QThreadPool *pool = nullptr) const;
+
     /*!
       Create a new Template with the content \a content identified by \a name.
 
@@ -181,6 +216,85 @@ public:
     */
     Template newTemplate(const QString &content, const QString &name) const;
 
+    /*!
+      Loads the Templates identified by \a names, using the threads of \a pool
+      and the calling thread. The global QThreadPool is used if \a pool is
+      null.
+
+      Returns the Templates in the order of \a names. As with loadByName, a
+      Template which could not be loaded or compiled reports an error.
+
+      This is useful to compile templates when an application starts rather
+      than on first use, when the Engine uses a CachingLoaderDecorator:
+
+      \code
+        auto loader = QSharedPointer<FileSystemTemplateLoader>::create();
+        loader->setTemplateDirs({"/usr/share/myapp/templates"});
+        engine->addTemplateLoader(QSharedPointer<CachingLoaderDecorator>::create(loader));
+
+        engine->precompile(loader->templateNames());
+      \endcode
+
+      The default libraries are loaded before the threads start.
+
+      If a loader throws, no further Templates are loaded, and the first
+      exception thrown is rethrown by this method once the loads which were
+      already started have finished.
+    */
+    QList<Template> precompile(const QStringList &names, QThreadPool *pool = nullptr);
+
+    /*!
+      Renders \a t once with each of \a contexts, using the threads of \a pool
+      and the calling thread. The global QThreadPool is used if \a pool is
+      null.
+
+      Returns the results in the order of \a contexts. The contexts must be
+      distinct objects, as each is used by one thread.
+
+      Threads take the next unrendered context when they finish one, so
+      contexts which take longer to render do not hold up the others.
+
+      \sa TemplateImpl::tryRender
+    */
+    QList<RenderResult> renderBatch(const Template &t, const QList<Context *> &contexts, QThreadPool *pool = nullptr) const;
+
+    /*!
+      Renders \a t \a count times, using the threads of \a pool and the
+      calling thread. The global QThreadPool is used if \a pool is null.
+
+      Before each render, \a setup is called with the index of the render and
+      a new Context to insert the data of the render into. When it is
+      rendered, \a resultReady is called with the index and the RenderResult.
+
+      This avoids creating all the contexts and keeping all the output in
+      memory at once:
+
+      \code
+        engine->renderBatch(t, recipients.size(),
+            [&](qsizetype i, Context *c) {
+              c->insert("recipient", recipients.at(i));
+            },
+            [&](qsizetype i, const RenderResult &result) {
+              send(recipients.at(i), result.output());
+            });
+      \endcode
+
+      Both functions are called in the threads doing the renders. \a setup
+      may be called concurrently, but \a resultReady is called by one thread at
+      a time. Results are reported as they finish, which is not necessarily
+      in the order of the indexes. This method returns when all the results
+      have been reported.
+
+      Both functions may throw. No further renders are then started, and the
+      first exception thrown is rethrown by this method once the renders
+      which were already started have finished.
+    */
+    void renderBatch(const Template &t,
+                     qsizetype count,
+                     const std::function<void(qsizetype index, Context *context)> &setup,
+                     const std::function<void(qsizetype index, const RenderResult &result)> &resultReady,
+                     QThreadPool *pool = nullptr) const;
+
     /*!
       Returns the libraries available by default to new Templates.
     */
@@ -211,6 +325,28 @@ public:
      */
     void setSmartTrimEnabled(bool enabled);
 
+    /*!
+      Returns whether the targets of \c {{% include %}} and \c {{% extends %}}
+      tags which are string literals are loaded when newly loaded templates
+      are compiled, rather than each time they are rendered.
+
+      This is false by default.
+     */
+    bool constantTemplateResolutionEnabled() const;
+
+    /*!
+      Sets whether the targets of \c {{% include %}} and \c {{% extends %}}
+      tags which are string literals are loaded when newly loaded templates
+      are compiled. This saves loading them again on each render.
+
+      A template which is resolved this way is not reloaded when it changes.
+      When the templates are loaded through a CachingLoaderDecorator, the
+      templates including or extending it are removed from the cache with it
+      instead. Targets which cannot be loaded when compiling are loaded when
+      rendering, and report their errors then.
+     */
+    void setConstantTemplateResolutionEnabled(bool enabled);
+
     /*!
       \internal
 
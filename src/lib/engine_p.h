@@ -15,6 +15,12 @@
 #include "pluginpointer_p.h"
 #include "taglibraryinterface.h"
 
+#include <QFuture>
+#include <QMutex>
+#include <QRecursiveMutex>
+
+#include <memory>
+
 namespace KTextTemplate
 {
 
@@ -76,17 +82,32 @@ class EnginePrivate
     QString getScriptLibraryName(const QString &name) const;
     ScriptableLibraryContainer *loadScriptableLibrary(const QString &name);
     PluginPointer<TagLibraryInterface> loadCppLibrary(const QString &name);
+    Template notFoundTemplate(const QString &name) const;
+
+    struct AsyncLoad;
+    static QFuture<Template> loadAsync(const QSharedPointer<AbstractTemplateLoader> &loader, const QString &name, const Engine *engine, QThreadPool *pool);
+    static void continueAsyncLoad(const std::shared_ptr<AsyncLoad> &load);
 
     Q_DECLARE_PUBLIC(Engine)
     Engine *const q_ptr;
 
+    // Libraries are loaded while parsing, which may happen on several threads
+    // rendering templates at once.
+    QRecursiveMutex m_libraryMutex;
     QHash<QString, PluginPointer<TagLibraryInterface>> m_libraries;
     QHash<QString, ScriptableLibraryContainer *> m_scriptableLibraries;
 
     QList<QSharedPointer<AbstractTemplateLoader>> m_loaders;
+
+    // The asynchronous loads which are not finished yet, so that requests
+    // for the same template share them.
+    mutable QMutex m_pendingLoadsMutex;
+    mutable QHash<QString, QFuture<Template>> m_pendingLoads;
+
     QStringList m_pluginDirs;
     QStringList m_defaultLibraries;
     bool m_smartTrimEnabled;
+    bool m_constantTemplateResolutionEnabled;
 };
 }
 
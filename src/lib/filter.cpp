@@ -11,13 +11,21 @@
 
 using namespace KTextTemplate;
 
+// The stream and context are kept per thread, so no instance of this is
+// created. The pointer to it is only kept for binary compatibility.
 class KTextTemplate::FilterPrivate
 {
-public:
-    OutputStream *m_stream = nullptr;
-    Context *m_context = nullptr;
 };
 
+namespace
+{
+// A Filter is shared by all the templates using it, which may be rendered
+// concurrently, so the stream and context it is applied with are kept per
+// thread.
+thread_local OutputStream *s_stream = nullptr;
+thread_local Context *s_context = nullptr;
+}
+
 Filter::Filter() = default;
 Filter::~Filter()
 {
@@ -31,29 +39,31 @@ void Filter::forgottenBaseCtorRemoveInKF7()
 
 void Filter::setStream(KTextTemplate::OutputStream *stream)
 {
-    if (!d_ptr) {
-        d_ptr = new FilterPrivate;
-    }
-    d_ptr->m_stream = stream;
+    s_stream = stream;
+}
+
+OutputStream *Filter::stream() const
+{
+    return s_stream;
 }
 
 SafeString Filter::escape(const QString &input) const
 {
-    return d_ptr->m_stream->escape(input);
+    return s_stream->escape(input);
 }
 
 SafeString Filter::escape(const SafeString &input) const
 {
     if (input.isSafe()) {
-        return {d_ptr->m_stream->escape(input), SafeString::IsSafe};
+        return {s_stream->escape(input), SafeString::IsSafe};
     }
-    return d_ptr->m_stream->escape(input);
+    return s_stream->escape(input);
 }
 
 SafeString Filter::conditionalEscape(const SafeString &input) const
 {
     if (!input.isSafe()) {
-        return d_ptr->m_stream->escape(input);
+        return s_stream->escape(input);
     }
     return input;
 }
@@ -65,13 +75,10 @@ bool Filter::isSafe() const
 
 Context *Filter::context() const
 {
-    return d_ptr ? d_ptr->m_context : nullptr;
+    return s_context;
 }
 
 void Filter::setContext(KTextTemplate::Context *context)
 {
-    if (!d_ptr) {
-        d_ptr = new FilterPrivate;
-    }
-    d_ptr->m_context = context;
+    s_context = context;
 }
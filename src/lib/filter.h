@@ -57,6 +57,9 @@ public:
     /*!
       FilterExpression makes it possible to access stream methods like escape
       while resolving.
+
+      The stream is only set for the calling thread, so that a Filter can be
+      applied by several threads rendering templates at the same time.
     */
     void setStream(OutputStream *stream);
 
@@ -111,6 +114,7 @@ private:
     // TODO KF7 remove this if Context becomes an argument to doFilter
     friend class FilterExpression;
     KTEXTTEMPLATE_NO_EXPORT void setContext(Context *context);
+    KTEXTTEMPLATE_NO_EXPORT OutputStream *stream() const;
 
     // can become a std::unique_ptr in KF7, but not before due to the above issue
     FilterPrivate *d_ptr = nullptr;
@@ -10,11 +10,13 @@
 #include "filterexpression.h"
 
 #include <QRegularExpression>
+#include <QScopeGuard>
 
 #include "exception.h"
 #include "filter.h"
 #include "parser.h"
 #include "util.h"
+#include "valuetype_p.h"
 
 using ArgFilter = std::pair<QSharedPointer<KTextTemplate::Filter>, KTextTemplate::Variable>;
 
@@ -28,6 +30,8 @@ class FilterExpressionPrivate
     {
     }
 
+    QVariant applyFilters(QVariant var, OutputStream *stream, Context *c) const;
+
     Variable m_variable;
     QList<ArgFilter> m_filters;
     QStringList m_filterNames;
@@ -173,16 +177,12 @@ FilterExpression &FilterExpression::operator=(const FilterExpression &other)
     return *this;
 }
 
-QVariant FilterExpression::resolve(OutputStream *stream, Context *c) const
+QVariant FilterExpressionPrivate::applyFilters(QVariant var, OutputStream *stream, Context *c) const
 {
-    Q_D(const FilterExpression);
-    auto var = d->m_variable.resolve(c);
-
-    auto it = d->m_filters.constBegin();
-    const auto end = d->m_filters.constEnd();
+    auto it = m_filters.constBegin();
+    const auto end = m_filters.constEnd();
     for (; it != end; ++it) {
         auto filter = it->first;
-        filter->setStream(stream);
         const auto argVar = it->second;
         auto arg = argVar.resolve(c);
 
@@ -203,11 +203,22 @@ QVariant FilterExpression::resolve(OutputStream *stream, Context *c) const
 
         const auto varString = getSafeString(var);
 
+        // Restore the stream and context of an enclosing filter, which may
+        // render a template using this one.
+        const auto previousStream = filter->stream();
+        const auto previousContext = filter->context();
+        filter->setStream(stream);
         filter->setContext(c);
-        var = filter->doFilter(var, arg, c->autoEscape());
-        filter->setContext(nullptr);
+        {
+            const auto restore = qScopeGuard([&] {
+                filter->setContext(previousContext);
+                filter->setStream(previousStream);
+            });
+            var = filter->doFilter(var, arg, c->autoEscape());
+        }
 
-        if (var.userType() == qMetaTypeId<KTextTemplate::SafeString>() || var.userType() == qMetaTypeId<QString>()) {
+        const auto kind = ValueType::of(var);
+        if (kind == ValueType::SafeString || kind == ValueType::String) {
             if (filter->isSafe() && varString.isSafe()) {
                 var = markSafe(getSafeString(var));
             } else if (varString.needsEscape()) {
@@ -217,10 +228,27 @@ QVariant FilterExpression::resolve(OutputStream *stream, Context *c) const
             }
         }
     }
+    return var;
+}
+
+QVariant FilterExpression::resolve(OutputStream *stream, Context *c) const
+{
+    Q_D(const FilterExpression);
+    const auto var = d->applyFilters(d->m_variable.resolve(c), stream, c);
     (*stream) << getSafeString(var).get();
     return var;
 }
 
+RenderValue FilterExpression::resolveValue(Context *c) const
+{
+    Q_D(const FilterExpression);
+    if (d->m_filters.isEmpty())
+        return d->m_variable.resolveValue(c);
+    // Filters take and return QVariants.
+    OutputStream _dummy;
+    return RenderValue::fromVariant(d->applyFilters(d->m_variable.resolve(c), &_dummy, c));
+}
+
 QVariant FilterExpression::resolve(Context *c) const
 {
     OutputStream _dummy;
@@ -230,7 +258,7 @@ QVariant FilterExpression::resolve(Context *c) const
 QVariantList FilterExpression::toList(Context *c) const
 {
     const auto var = resolve(c);
-    if (!var.canConvert<QVariantList>())
+    if (ValueType::of(var) != ValueType::List)
         return {};
     return var.value<QVariantList>();
 }
@@ -167,6 +167,10 @@ public:
     QStringList filters() const;
 
 private:
+    // Resolves the FilterExpression as it is rendered by a VariableNode.
+    KTEXTTEMPLATE_NO_EXPORT RenderValue resolveValue(Context *c) const;
+    friend class VariableNode;
+
     Q_DECLARE_PRIVATE(FilterExpression)
     FilterExpressionPrivate *const d_ptr;
 };
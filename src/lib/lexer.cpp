@@ -9,165 +9,267 @@
 
 #include "lexer_p.h"
 
-using namespace KTextTemplate;
-
-using TextProcessingState = State<TextProcessingMachine::Type>;
-using TextProcessingTransition = TextProcessingMachine::Transition;
-
-using ChurningState = LexerObject<TextProcessingState, NullTest, MarksClearer>;
-using FinalizeTokenState = LexerObject<TextProcessingState, NullTest, TokenFinalizer>;
-using EofHandler = LexerObject<TextProcessingTransition, NullTest, TokenFinalizer>;
-using EofHandlerWithTrimming = LexerObject<TextProcessingTransition, NullTest, TokenFinalizerWithTrimming>;
+#include <algorithm>
+#include <bit>
 
-using MaybeTemplateSyntaxHandler = CharacterTransition<'{'>;
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
-using TagStartHandler = CharacterTransition<'%', MarkStartSyntax>;
-using CommentStartHandler = CharacterTransition<'#', MarkStartSyntax>;
-using TagEndHandler = CharacterTransition<'%'>;
-using CommentEndHandler = CharacterTransition<'#'>;
-using BeginValueHandler = CharacterTransition<'{', MarkStartSyntax>;
-using MaybeEndValueHandler = CharacterTransition<'}'>;
-using NewlineHandler = CharacterTransition<'\n', MarkNewline>;
-using EndTemplateSyntaxHandler = CharacterTransition<'}', MarkEndSyntax>;
-using NotEndTemplateSyntaxHandler = NegateCharacterTransition<'}'>;
-
-using NotBeginTemplateSyntaxHandler = LexerObject<TextProcessingTransition, Negate<OrTest<CharacterTest<'{'>, OrTest<CharacterTest<'#'>, CharacterTest<'%'>>>>>;
+using namespace KTextTemplate;
 
-using NotBeginTemplateSyntaxOrNewlineHandler =
-    LexerObject<TextProcessingTransition, Negate<OrTest<CharacterTest<'{'>, OrTest<CharacterTest<'#'>, OrTest<CharacterTest<'%'>, CharacterTest<'\n'>>>>>>;
+namespace
+{
 
-using NotTagCommentOrNewlineHandler =
-    LexerObject<TextProcessingTransition, Negate<OrTest<CharacterTest<'#'>, OrTest<CharacterTest<'%'>, CharacterTest<'\n'>>>>>;
+enum LexerState : quint8 {
+    ProcessingText,
+    ProcessingPostNewline,
+    ProcessingBeginTemplateSyntax,
+    ProcessingTag,
+    ProcessingComment,
+    MaybeProcessingValue,
+    ProcessingValue,
+    ProcessingEndTag,
+    ProcessingEndComment,
+    ProcessingEndValue,
+    ProcessingPostTemplateSyntax,
+    ProcessingPostTemplateSyntaxWhitespace,
+    LexerStateCount
+};
+
+enum CharacterClass : quint8 {
+    BeginBraceCharacter, ///< '{'
+    EndBraceCharacter, ///< '}'
+    PercentCharacter, ///< '%'
+    HashCharacter, ///< '#'
+    NewlineCharacter, ///< '\n'
+    WhitespaceCharacter, ///< Any other whitespace
+    OtherCharacter,
+    CharacterClassCount
+};
+
+// Masks of character classes, used to describe the characters which trigger a
+// transition.
+enum CharacterMask {
+    BeginBrace = 1 << BeginBraceCharacter,
+    EndBrace = 1 << EndBraceCharacter,
+    Percent = 1 << PercentCharacter,
+    Hash = 1 << HashCharacter,
+    Newline = 1 << NewlineCharacter,
+    Whitespace = 1 << WhitespaceCharacter,
+    AnyCharacter = (1 << CharacterClassCount) - 1
+};
+
+// Actions are performed in the order of their values.
+enum LexerAction {
+    NoAction = 0,
+    MarkEndSyntax = 1 << 0,
+    FinalizeToken = 1 << 1,
+    FinalizeTokenWithTrimming = 1 << 2,
+    MarkStartSyntax = 1 << 3,
+    MarkNewline = 1 << 4,
+    ClearMarkers = 1 << 5
+};
+
+struct LexerTransition {
+    quint8 targetState;
+    quint8 actions;
+};
+
+struct TransitionTable {
+    LexerTransition transitions[LexerStateCount][CharacterClassCount];
+    quint8 endActions[LexerStateCount];
+};
+
+class TransitionTableBuilder
+{
+public:
+    constexpr TransitionTableBuilder()
+    {
+        // A character which does not trigger a transition leaves the state
+        // unchanged.
+        for (int state = 0; state < LexerStateCount; ++state) {
+            for (int characterClass = 0; characterClass < CharacterClassCount; ++characterClass) {
+                m_table.transitions[state][characterClass] = {static_cast<quint8>(state), NoAction};
+                m_assigned[state][characterClass] = false;
+            }
+            m_table.endActions[state] = FinalizeToken;
+        }
+    }
 
-using NonWhitespaceLineTextHandler = LexerObject<TextProcessingTransition, Negate<OrTest<IsSpace, CharacterTest<'{'>>>>;
+    // Transitions are added in order of priority. A character class which
+    // already triggers a transition out of source is not reassigned.
+    constexpr void addTransition(LexerState source, int characters, LexerState target, int actions = NoAction)
+    {
+        // Entering the text state starts a new token.
+        if (target == ProcessingText && source != ProcessingText)
+            actions |= ClearMarkers;
+
+        for (int characterClass = 0; characterClass < CharacterClassCount; ++characterClass) {
+            if (!(characters & (1 << characterClass)) || m_assigned[source][characterClass])
+                continue;
+            m_table.transitions[source][characterClass] = {static_cast<quint8>(target), static_cast<quint8>(actions)};
+            m_assigned[source][characterClass] = true;
+        }
+    }
 
-using WhitespaceNonNewlineHandler = LexerObject<TextProcessingTransition, AndTest<Negate<CharacterTest<'\n'>>, IsSpace>>;
+    constexpr void setEndActions(LexerState state, int actions)
+    {
+        m_table.endActions[state] = static_cast<quint8>(actions);
+    }
 
-using FinalizingLineTextHandler = LexerObject<TextProcessingTransition, Negate<OrTest<CharacterTest<'{'>, IsSpace>>, TokenFinalizer>;
+    constexpr TransitionTable table() const
+    {
+        return m_table;
+    }
 
-using SyntaxBoundaryNewlineHandler = CharacterTransition<'\n', TokenFinalizerWithTrimmingAndNewline>;
-using SyntaxBoundaryHandler = CharacterTransition<'{', FinalizeAndMarkStartSyntax>;
+private:
+    TransitionTable m_table{};
+    bool m_assigned[LexerStateCount][CharacterClassCount]{};
+};
 
-template<typename Transition>
-void addTransition(TextProcessingState *source, Lexer *lexer, TextProcessingState *target)
+constexpr TransitionTable createTransitionTable(Lexer::TrimType type)
 {
-    auto tr = new Transition(lexer, source);
-    tr->setTargetState(target);
-}
+    const auto smartTrim = type == Lexer::SmartTrim;
+    const auto postNewlineState = smartTrim ? ProcessingPostNewline : ProcessingText;
 
-TextProcessingMachine *createMachine(Lexer *lexer, Lexer::TrimType type)
-{
-    auto machine = new TextProcessingMachine;
-
-    auto notFinished = new TextProcessingState(machine);
-    auto finished = new TextProcessingState(machine);
-    machine->setInitialState(notFinished);
-
-    auto processingText = new ChurningState(lexer, notFinished);
-    auto processingPostNewline = new TextProcessingState(notFinished);
-    auto processingBeginTemplateSyntax = new TextProcessingState(notFinished);
-    auto processingTag = new TextProcessingState(notFinished);
-    auto processingComment = new TextProcessingState(notFinished);
-    auto processingValue = new TextProcessingState(notFinished);
-    auto maybeProcessingValue = new TextProcessingState(notFinished);
-    auto processingEndTag = new TextProcessingState(notFinished);
-    auto processingEndComment = new TextProcessingState(notFinished);
-    auto processingEndValue = new TextProcessingState(notFinished);
-    TextProcessingState *processingPostTemplateSyntax;
-
-    if (type == Lexer::SmartTrim)
-        processingPostTemplateSyntax = new TextProcessingState(notFinished);
-    else
-        processingPostTemplateSyntax = new FinalizeTokenState(lexer, notFinished);
-    auto processingPostTemplateSyntaxWhitespace = new TextProcessingState(notFinished);
+    TransitionTableBuilder builder;
 
-    if (type == Lexer::SmartTrim)
-        notFinished->setInitialState(processingPostNewline);
-    else
-        notFinished->setInitialState(processingText);
+    if (smartTrim) {
+        builder.addTransition(ProcessingText, Newline, ProcessingPostNewline, MarkNewline);
 
-    if (type == Lexer::SmartTrim) {
-        addTransition<NewlineHandler>(processingText, lexer, processingPostNewline);
-
-        addTransition<NewlineHandler>(processingPostNewline, lexer, processingPostNewline);
-        addTransition<MaybeTemplateSyntaxHandler>(processingPostNewline, lexer, processingBeginTemplateSyntax);
-        addTransition<NonWhitespaceLineTextHandler>(processingPostNewline, lexer, processingText);
+        builder.addTransition(ProcessingPostNewline, Newline, ProcessingPostNewline, MarkNewline);
+        builder.addTransition(ProcessingPostNewline, BeginBrace, ProcessingBeginTemplateSyntax);
+        builder.addTransition(ProcessingPostNewline, AnyCharacter & ~(Whitespace | Newline | BeginBrace), ProcessingText);
     }
-    addTransition<MaybeTemplateSyntaxHandler>(processingText, lexer, processingBeginTemplateSyntax);
+    builder.addTransition(ProcessingText, BeginBrace, ProcessingBeginTemplateSyntax);
 
-    addTransition<TagStartHandler>(processingBeginTemplateSyntax, lexer, processingTag);
-    addTransition<CommentStartHandler>(processingBeginTemplateSyntax, lexer, processingComment);
-    addTransition<BeginValueHandler>(processingBeginTemplateSyntax, lexer, maybeProcessingValue);
+    builder.addTransition(ProcessingBeginTemplateSyntax, Percent, ProcessingTag, MarkStartSyntax);
+    builder.addTransition(ProcessingBeginTemplateSyntax, Hash, ProcessingComment, MarkStartSyntax);
+    builder.addTransition(ProcessingBeginTemplateSyntax, BeginBrace, MaybeProcessingValue, MarkStartSyntax);
 
-    if (type == Lexer::SmartTrim) {
-        addTransition<NotBeginTemplateSyntaxOrNewlineHandler>(processingBeginTemplateSyntax, lexer, processingText);
-        addTransition<NewlineHandler>(processingBeginTemplateSyntax, lexer, processingPostNewline);
+    if (smartTrim) {
+        builder.addTransition(ProcessingBeginTemplateSyntax, AnyCharacter & ~(BeginBrace | Hash | Percent | Newline), ProcessingText);
+        builder.addTransition(ProcessingBeginTemplateSyntax, Newline, ProcessingPostNewline, MarkNewline);
     } else {
-        addTransition<NotBeginTemplateSyntaxHandler>(processingBeginTemplateSyntax, lexer, processingText);
+        builder.addTransition(ProcessingBeginTemplateSyntax, AnyCharacter & ~(BeginBrace | Hash | Percent), ProcessingText);
     }
 
-    addTransition<NewlineHandler>(processingTag, lexer, type == Lexer::SmartTrim ? processingPostNewline : processingText);
-    addTransition<TagEndHandler>(processingTag, lexer, processingEndTag);
+    builder.addTransition(ProcessingTag, Newline, postNewlineState, MarkNewline);
+    builder.addTransition(ProcessingTag, Percent, ProcessingEndTag);
 
-    addTransition<NewlineHandler>(processingComment, lexer, type == Lexer::SmartTrim ? processingPostNewline : processingText);
-    addTransition<CommentEndHandler>(processingComment, lexer, processingEndComment);
+    builder.addTransition(ProcessingComment, Newline, postNewlineState, MarkNewline);
+    builder.addTransition(ProcessingComment, Hash, ProcessingEndComment);
 
-    addTransition<TagStartHandler>(maybeProcessingValue, lexer, processingTag);
-    addTransition<CommentStartHandler>(maybeProcessingValue, lexer, processingComment);
-    addTransition<NotTagCommentOrNewlineHandler>(maybeProcessingValue, lexer, processingValue);
-    addTransition<NewlineHandler>(maybeProcessingValue, lexer, type == Lexer::SmartTrim ? processingPostNewline : processingText);
+    builder.addTransition(MaybeProcessingValue, Percent, ProcessingTag, MarkStartSyntax);
+    builder.addTransition(MaybeProcessingValue, Hash, ProcessingComment, MarkStartSyntax);
+    builder.addTransition(MaybeProcessingValue, AnyCharacter & ~(Hash | Percent | Newline), ProcessingValue);
+    builder.addTransition(MaybeProcessingValue, Newline, postNewlineState, MarkNewline);
 
-    addTransition<NewlineHandler>(processingValue, lexer, type == Lexer::SmartTrim ? processingPostNewline : processingText);
-    addTransition<MaybeEndValueHandler>(processingValue, lexer, processingEndValue);
+    builder.addTransition(ProcessingValue, Newline, postNewlineState, MarkNewline);
+    builder.addTransition(ProcessingValue, EndBrace, ProcessingEndValue);
 
-    addTransition<NewlineHandler>(processingEndTag, lexer, processingPostNewline);
-    addTransition<NotEndTemplateSyntaxHandler>(processingEndTag, lexer, processingTag);
-    addTransition<EndTemplateSyntaxHandler>(processingEndTag, lexer, processingPostTemplateSyntax);
+    // Without smart trimming, the token is finalized as soon as the end of the
+    // template syntax is reached.
+    const auto postTemplateSyntaxState = smartTrim ? ProcessingPostTemplateSyntax : ProcessingText;
+    const auto endTemplateSyntaxActions = smartTrim ? MarkEndSyntax : MarkEndSyntax | FinalizeToken;
 
-    addTransition<NewlineHandler>(processingEndComment, lexer, processingPostNewline);
-    addTransition<NotEndTemplateSyntaxHandler>(processingEndComment, lexer, processingComment);
-    addTransition<EndTemplateSyntaxHandler>(processingEndComment, lexer, processingPostTemplateSyntax);
+    builder.addTransition(ProcessingEndTag, Newline, ProcessingPostNewline, MarkNewline);
+    builder.addTransition(ProcessingEndTag, AnyCharacter & ~EndBrace, ProcessingTag);
+    builder.addTransition(ProcessingEndTag, EndBrace, postTemplateSyntaxState, endTemplateSyntaxActions);
 
-    addTransition<NewlineHandler>(processingEndValue, lexer, processingPostNewline);
-    addTransition<NotEndTemplateSyntaxHandler>(processingEndValue, lexer, processingValue);
-    addTransition<EndTemplateSyntaxHandler>(processingEndValue, lexer, processingPostTemplateSyntax);
+    builder.addTransition(ProcessingEndComment, Newline, ProcessingPostNewline, MarkNewline);
+    builder.addTransition(ProcessingEndComment, AnyCharacter & ~EndBrace, ProcessingComment);
+    builder.addTransition(ProcessingEndComment, EndBrace, postTemplateSyntaxState, endTemplateSyntaxActions);
 
-    if (type != Lexer::SmartTrim) {
-        processingPostTemplateSyntax->setUnconditionalTransition(processingText);
-    } else {
-        addTransition<SyntaxBoundaryNewlineHandler>(processingPostTemplateSyntax, lexer, processingPostNewline);
-        addTransition<WhitespaceNonNewlineHandler>(processingPostTemplateSyntax, lexer, processingPostTemplateSyntaxWhitespace);
-        addTransition<FinalizingLineTextHandler>(processingPostTemplateSyntax, lexer, processingText);
-        addTransition<SyntaxBoundaryHandler>(processingPostTemplateSyntax, lexer, processingBeginTemplateSyntax);
+    builder.addTransition(ProcessingEndValue, Newline, ProcessingPostNewline, MarkNewline);
+    builder.addTransition(ProcessingEndValue, AnyCharacter & ~EndBrace, ProcessingValue);
+    builder.addTransition(ProcessingEndValue, EndBrace, postTemplateSyntaxState, endTemplateSyntaxActions);
+
+    if (smartTrim) {
+        builder.addTransition(ProcessingPostTemplateSyntax, Newline, ProcessingPostNewline, FinalizeTokenWithTrimming | MarkNewline);
+        builder.addTransition(ProcessingPostTemplateSyntax, Whitespace, ProcessingPostTemplateSyntaxWhitespace);
+        builder.addTransition(ProcessingPostTemplateSyntax, AnyCharacter & ~(BeginBrace | Whitespace | Newline), ProcessingText, FinalizeToken);
+        builder.addTransition(ProcessingPostTemplateSyntax, BeginBrace, ProcessingBeginTemplateSyntax, FinalizeToken | MarkStartSyntax);
 
         // NOTE: We only have to transition to this if there was whitespace
         // before the opening tag. Maybe store that in an external state property?
         // Actually, this may be a bug if we try to finalize with trimming and
         // there is no leading whitespace.
-        addTransition<SyntaxBoundaryNewlineHandler>(processingPostTemplateSyntaxWhitespace, lexer, processingPostNewline);
-        addTransition<FinalizingLineTextHandler>(processingPostTemplateSyntaxWhitespace, lexer, processingText);
-        addTransition<SyntaxBoundaryHandler>(processingPostTemplateSyntaxWhitespace, lexer, processingBeginTemplateSyntax);
+        builder.addTransition(ProcessingPostTemplateSyntaxWhitespace, Newline, ProcessingPostNewline, FinalizeTokenWithTrimming | MarkNewline);
+        builder.addTransition(ProcessingPostTemplateSyntaxWhitespace, AnyCharacter & ~(BeginBrace | Whitespace | Newline), ProcessingText, FinalizeToken);
+        builder.addTransition(ProcessingPostTemplateSyntaxWhitespace, BeginBrace, ProcessingBeginTemplateSyntax, FinalizeToken | MarkStartSyntax);
+
+        builder.setEndActions(ProcessingPostTemplateSyntax, FinalizeTokenWithTrimming);
+        builder.setEndActions(ProcessingPostTemplateSyntaxWhitespace, FinalizeTokenWithTrimming);
     }
 
-    {
-        auto handler = new EofHandler(lexer, notFinished);
-        handler->setTargetState(finished);
-        notFinished->setEndTransition(handler);
+    return builder.table();
+}
+
+constexpr TransitionTable s_noSmartTrimTable = createTransitionTable(Lexer::NoSmartTrim);
+constexpr TransitionTable s_smartTrimTable = createTransitionTable(Lexer::SmartTrim);
+
+inline CharacterClass characterClass(QChar c)
+{
+    switch (c.unicode()) {
+    case u'{':
+        return BeginBraceCharacter;
+    case u'}':
+        return EndBraceCharacter;
+    case u'%':
+        return PercentCharacter;
+    case u'#':
+        return HashCharacter;
+    case u'\n':
+        return NewlineCharacter;
+    default:
+        return c.isSpace() ? WhitespaceCharacter : OtherCharacter;
     }
+}
+
+/*
+  Returns a pointer to the first '{' or newline in [begin, end), or end if
+  there is none. Literal text can only end at one of those characters, so
+  everything before it can be skipped without running the state machine.
+*/
+const QChar *findTextBoundary(const QChar *begin, const QChar *end)
+{
+    auto it = reinterpret_cast<const char16_t *>(begin);
+    const auto last = reinterpret_cast<const char16_t *>(end);
 
-    if (type == Lexer::SmartTrim) {
-        {
-            auto handler = new EofHandlerWithTrimming(lexer, processingPostTemplateSyntaxWhitespace);
-            handler->setTargetState(finished);
-            processingPostTemplateSyntaxWhitespace->setEndTransition(handler);
+#if defined(__AVX2__)
+    {
+        const auto braces = _mm256_set1_epi16(u'{');
+        const auto newlines = _mm256_set1_epi16(u'\n');
+        for (; last - it >= 16; it += 16) {
+            const auto data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(it));
+            const auto matches = _mm256_or_si256(_mm256_cmpeq_epi16(data, braces), _mm256_cmpeq_epi16(data, newlines));
+            const auto mask = static_cast<uint>(_mm256_movemask_epi8(matches));
+            if (mask)
+                return reinterpret_cast<const QChar *>(it + std::countr_zero(mask) / 2);
         }
-        {
-            auto handler = new EofHandlerWithTrimming(lexer, processingPostTemplateSyntax);
-            handler->setTargetState(finished);
-            processingPostTemplateSyntax->setEndTransition(handler);
+    }
+#endif
+#if defined(__SSE2__)
+    {
+        const auto braces = _mm_set1_epi16(u'{');
+        const auto newlines = _mm_set1_epi16(u'\n');
+        for (; last - it >= 8; it += 8) {
+            const auto data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+            const auto matches = _mm_or_si128(_mm_cmpeq_epi16(data, braces), _mm_cmpeq_epi16(data, newlines));
+            const auto mask = static_cast<uint>(_mm_movemask_epi8(matches));
+            if (mask)
+                return reinterpret_cast<const QChar *>(it + std::countr_zero(mask) / 2);
         }
     }
-    return machine;
+#endif
+    for (; it != last; ++it) {
+        if (*it == u'{' || *it == u'\n')
+            break;
+    }
+    return reinterpret_cast<const QChar *>(it);
+}
 }
 
 Lexer::Lexer(const QString &templateString)
@@ -184,37 +286,207 @@ void Lexer::clearMarkers()
     m_newlinePosition = -1;
 }
 
-void Lexer::reset()
+LexerCheckpoint Lexer::initialCheckpoint(TrimType type)
+{
+    return {0, type == SmartTrim ? ProcessingPostNewline : ProcessingText, 0, -1, -1, -1, 0, 0};
+}
+
+QList<int> Lexer::tokenOffsets() const
+{
+    return m_tokenOffsets;
+}
+
+void Lexer::restore(const LexerCheckpoint &checkpoint)
 {
     m_tokenList.clear();
-    m_lineCount = 0;
-    m_upto = 0;
-    m_processedUpto = 0;
-    clearMarkers();
+    m_tokenOffsets.clear();
+    m_upto = checkpoint.position;
+    m_processedUpto = checkpoint.processedUpto;
+    m_startSyntaxPosition = checkpoint.startSyntaxPosition;
+    m_endSyntaxPosition = checkpoint.endSyntaxPosition;
+    m_newlinePosition = checkpoint.newlinePosition;
+    m_lineCount = checkpoint.lineCount;
+    m_tokenOffset = checkpoint.tokenCount;
 }
 
-QList<Token> Lexer::tokenize(TrimType type)
+LexerCheckpoint Lexer::checkpoint(int state) const
 {
-    auto machine = createMachine(this, type);
+    return {m_upto + 1,
+            state,
+            m_processedUpto,
+            m_startSyntaxPosition,
+            m_endSyntaxPosition,
+            m_newlinePosition,
+            m_lineCount,
+            m_tokenOffset + static_cast<int>(m_tokenList.size())};
+}
 
-    machine->start();
+QList<Token> Lexer::tokenize(TrimType type)
+{
+    return tokenize(type, initialCheckpoint(type), nullptr);
+}
 
-    auto it = m_templateString.constBegin();
-    const auto end = m_templateString.constEnd();
+QList<Token> Lexer::tokenize(TrimType type,
+                             const LexerCheckpoint &from,
+                             QList<LexerCheckpoint> *checkpoints,
+                             const std::function<bool(const LexerCheckpoint &)> &stop)
+{
+    const auto &table = type == SmartTrim ? s_smartTrimTable : s_noSmartTrimTable;
 
-    reset();
-    for (; it != end; ++it, ++m_upto)
-        machine->processCharacter(it);
+    restore(from);
 
-    machine->finished();
+    int state = from.state;
 
-    machine->stop();
+    const auto data = m_templateString.constData();
+    const auto size = m_templateString.size();
+    for (; m_upto < size; ++m_upto) {
+        if (state == ProcessingText) {
+            m_upto = findTextBoundary(data + m_upto, data + size) - data;
+            if (m_upto == size)
+                break;
+        }
+        const auto &transition = table.transitions[state][characterClass(data[m_upto])];
+        state = transition.targetState;
+        if (transition.actions == NoAction)
+            continue;
+
+        performActions(transition.actions);
+
+        if (checkpoints && (transition.actions & (FinalizeToken | FinalizeTokenWithTrimming))) {
+            const auto reached = checkpoint(state);
+            checkpoints->append(reached);
+            if (stop && stop(reached))
+                return m_tokenList;
+        }
+    }
 
-    delete machine;
+    performActions(table.endActions[state]);
 
     return m_tokenList;
 }
 
+LexerUpdate Lexer::retokenize(TrimType type,
+                              const QList<LexerCheckpoint> &checkpoints,
+                              int tokenCount,
+                              int position,
+                              int removed,
+                              int added,
+                              const std::function<int(int)> &rangeStart,
+                              const std::function<int(int)> &rangeEnd)
+{
+    const auto delta = added - removed;
+    const auto editEnd = position + removed;
+
+    const auto byPosition = [](const LexerCheckpoint &checkpoint, int pos) {
+        return checkpoint.position < pos;
+    };
+
+    // Everything finalized before the last checkpoint preceding the edit is
+    // unchanged. Resume from a checkpoint which also precedes the range the
+    // first possibly changed token belongs to.
+    auto from = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), position, [](int pos, const LexerCheckpoint &checkpoint) {
+        return pos < checkpoint.position;
+    });
+    Q_ASSERT(from != checkpoints.cbegin());
+    --from;
+    const auto firstToken = rangeStart(from->tokenCount);
+    while (from->tokenCount > firstToken)
+        --from;
+
+    // A marker before the processed position has no influence on the lexer.
+    const auto equivalent = [&](const LexerCheckpoint &previous, const LexerCheckpoint &current) {
+        if (current.state != previous.state)
+            return false;
+        if (previous.processedUpto < editEnd || current.processedUpto != previous.processedUpto + delta)
+            return false;
+        const std::pair<int, int> markers[] = {
+            {previous.startSyntaxPosition, current.startSyntaxPosition},
+            {previous.endSyntaxPosition, current.endSyntaxPosition},
+            {previous.newlinePosition, current.newlinePosition},
+        };
+        for (const auto &[previousMarker, currentMarker] : markers) {
+            const auto relevant = previousMarker >= previous.processedUpto;
+            if (relevant != (currentMarker >= current.processedUpto))
+                return false;
+            if (relevant && currentMarker != previousMarker + delta)
+                return false;
+        }
+        return true;
+    };
+
+    QList<LexerCheckpoint> reached;
+    auto synced = checkpoints.cend();
+    qsizetype syncedIndex = -1;
+    auto previousTokenEnd = tokenCount;
+    auto tokenDelta = 0;
+
+    const auto stop = [&](const LexerCheckpoint &checkpoint) {
+        if (synced == checkpoints.cend()) {
+            if (checkpoint.position < position + added)
+                return false;
+            const auto previous = std::lower_bound(checkpoints.cbegin(), checkpoints.cend(), checkpoint.position - delta, byPosition);
+            if (previous == checkpoints.cend() || previous->position != checkpoint.position - delta || !equivalent(*previous, checkpoint))
+                return false;
+            synced = previous;
+            syncedIndex = reached.size() - 1;
+            tokenDelta = checkpoint.tokenCount - previous->tokenCount;
+            previousTokenEnd = previous->tokenCount > firstToken ? rangeEnd(previous->tokenCount - 1) : firstToken;
+        }
+        return checkpoint.tokenCount >= previousTokenEnd + tokenDelta;
+    };
+
+    const auto tokens = tokenize(type, *from, &reached, stop);
+
+    LexerUpdate update;
+    update.firstToken = firstToken;
+    update.previousTokenEnd = previousTokenEnd;
+    update.checkpoints = checkpoints.mid(0, from - checkpoints.cbegin() + 1);
+
+    // Without a match, everything up to the end of the template was tokenized.
+    if (synced == checkpoints.cend()) {
+        update.tokens = tokens.mid(firstToken - from->tokenCount);
+        update.checkpoints.append(reached);
+        return update;
+    }
+
+    update.tokens = tokens.mid(firstToken - from->tokenCount, previousTokenEnd + tokenDelta - firstToken);
+    update.checkpoints.append(reached.mid(0, syncedIndex + 1));
+    const auto lineDelta = reached.at(syncedIndex).lineCount - synced->lineCount;
+    update.lineDelta = lineDelta;
+    // Markers before the edit precede the processed position, and are
+    // irrelevant.
+    const auto shift = [&](int marker) {
+        return marker >= editEnd ? marker + delta : -1;
+    };
+    for (auto it = synced + 1; it != checkpoints.cend(); ++it) {
+        update.checkpoints.append({it->position + delta,
+                                   it->state,
+                                   shift(it->processedUpto),
+                                   shift(it->startSyntaxPosition),
+                                   shift(it->endSyntaxPosition),
+                                   shift(it->newlinePosition),
+                                   it->lineCount + lineDelta,
+                                   it->tokenCount + tokenDelta});
+    }
+    return update;
+}
+
+void Lexer::performActions(int actions)
+{
+    if (actions & MarkEndSyntax)
+        markEndSyntax();
+    if (actions & FinalizeToken)
+        finalizeToken();
+    if (actions & FinalizeTokenWithTrimming)
+        finalizeTokenWithTrimmedWhitespace();
+    if (actions & MarkStartSyntax)
+        markStartSyntax();
+    if (actions & MarkNewline)
+        markNewline();
+    if (actions & ClearMarkers)
+        clearMarkers();
+}
+
 void Lexer::markStartSyntax()
 {
     m_startSyntaxPosition = m_upto;
@@ -264,11 +536,13 @@ void Lexer::finalizeTokenWithTrimmedWhitespace()
 void Lexer::finalizeToken(int nextPosition, bool processSyntax)
 {
     {
+        Q_ASSERT(nextPosition >= m_processedUpto);
         Token token;
-        token.content = m_templateString.mid(m_processedUpto, nextPosition - m_processedUpto);
+        token.content = QString::fromRawData(m_templateString.constData() + m_processedUpto, nextPosition - m_processedUpto);
         token.tokenType = TextToken;
         token.linenumber = m_lineCount;
         m_tokenList.append(token);
+        m_tokenOffsets.append(m_processedUpto);
     }
 
     m_processedUpto = nextPosition;
@@ -282,8 +556,9 @@ void Lexer::finalizeToken(int nextPosition, bool processSyntax)
     if (differentiator == QLatin1Char('#'))
         return;
 
+    const auto content = QStringView(m_templateString).mid(m_startSyntaxPosition + 1, m_endSyntaxPosition - m_startSyntaxPosition - 3).trimmed();
     Token syntaxToken;
-    syntaxToken.content = m_templateString.mid(m_startSyntaxPosition + 1, m_endSyntaxPosition - m_startSyntaxPosition - 3).trimmed();
+    syntaxToken.content = content.toString();
     syntaxToken.linenumber = m_lineCount;
 
     if (differentiator == QLatin1Char('{')) {
@@ -293,4 +568,5 @@ void Lexer::finalizeToken(int nextPosition, bool processSyntax)
         syntaxToken.tokenType = BlockToken;
     }
     m_tokenList.append(syntaxToken);
+    m_tokenOffsets.append(content.isEmpty() ? m_startSyntaxPosition + 1 : int(content.data() - m_templateString.constData()));
 }
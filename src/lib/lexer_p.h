@@ -10,14 +10,53 @@
 #ifndef KTEXTTEMPLATE_LEXER_P_H
 #define KTEXTTEMPLATE_LEXER_P_H
 
-#include "textprocessingmachine_p.h"
 #include "token.h"
 
 #include <QList>
 
+#include <functional>
+
 namespace KTextTemplate
 {
 
+/*
+  The state of the Lexer after it finalized a token. Lexing can be resumed
+  from a checkpoint, and two runs which reach equivalent checkpoints produce
+  the same tokens from there on.
+*/
+struct LexerCheckpoint {
+    int position; ///< The position of the next character to process
+    int state;
+    int processedUpto;
+    int startSyntaxPosition;
+    int endSyntaxPosition;
+    int newlinePosition;
+    int lineCount;
+    int tokenCount; ///< The number of tokens finalized before the checkpoint
+};
+
+/*
+  The result of re-tokenizing a template after an edit. The tokens replace the
+  previous tokens in the range [firstToken, previousTokenEnd).
+*/
+struct LexerUpdate {
+    int firstToken;
+    int previousTokenEnd;
+    int lineDelta = 0; ///< The change of the line numbers of the following tokens
+    QList<Token> tokens;
+    QList<LexerCheckpoint> checkpoints; ///< The checkpoints of the whole edited template
+};
+
+/*
+  Splits a template string into a list of Tokens.
+
+  The lexer is a flat state machine driven by a precomputed transition table
+  (one for each TrimType). Each character of the template is classified,
+  and the table gives the next state and the actions to perform.
+
+  The content of text tokens is not copied, but references the data of the
+  template string. It is only valid while that string is alive and unmodified.
+*/
 class Lexer
 {
 public:
@@ -28,145 +67,77 @@ public:
 
     QList<Token> tokenize(TrimType type = NoSmartTrim);
 
+    /*
+      Tokenizes the template string starting from the checkpoint \a from, which
+      was recorded while tokenizing a string with the same content up to its
+      position. Returns the tokens finalized after the checkpoint.
+
+      Each checkpoint reached is appended to \a checkpoints. If \a stop
+      returns true for one of them, tokenizing stops there rather than at the
+      end of the template.
+    */
+    QList<Token> tokenize(TrimType type,
+                          const LexerCheckpoint &from,
+                          QList<LexerCheckpoint> *checkpoints,
+                          const std::function<bool(const LexerCheckpoint &)> &stop = {});
+
+    /*
+      Returns the checkpoint at the start of a template.
+    */
+    static LexerCheckpoint initialCheckpoint(TrimType type);
+
+    /*
+      Returns the offsets in the template string of the content of the tokens
+      returned by the last call to tokenize().
+    */
+    QList<int> tokenOffsets() const;
+
+    /*
+      Re-tokenizes the template string after an edit which replaced
+      \a removed characters at \a position with \a added characters.
+      \a checkpoints and \a tokenCount describe the previous content, the
+      first checkpoint being the initial one.
+
+      Only the part of the template from the last checkpoint before the edit
+      up to the point where the state of the lexer matches a previous
+      checkpoint again is tokenized. \a rangeStart and \a rangeEnd map the index
+      of a previous token to the first and past-the-end tokens which must be
+      replaced together with it, for example all the tokens of a node.
+    */
+    LexerUpdate retokenize(TrimType type,
+                           const QList<LexerCheckpoint> &checkpoints,
+                           int tokenCount,
+                           int position,
+                           int removed,
+                           int added,
+                           const std::function<int(int)> &rangeStart,
+                           const std::function<int(int)> &rangeEnd);
+
+private:
+    void restore(const LexerCheckpoint &checkpoint);
+    LexerCheckpoint checkpoint(int state) const;
+    void performActions(int actions);
+
     void markStartSyntax();
     void markEndSyntax();
     void markNewline();
     void clearMarkers();
     void finalizeToken();
     void finalizeTokenWithTrimmedWhitespace();
-
-private:
-    void reset();
     void finalizeToken(int nextPosition, bool processSyntax);
 
 private:
     QString m_templateString;
 
     QList<Token> m_tokenList;
+    QList<int> m_tokenOffsets;
     int m_lineCount;
     int m_upto;
     int m_processedUpto;
     int m_startSyntaxPosition;
     int m_endSyntaxPosition;
     int m_newlinePosition;
-};
-
-struct NullLexerAction {
-    static void doAction(Lexer *)
-    {
-    }
-};
-
-template<typename TType, typename Test, typename Action1 = NullLexerAction, typename Action2 = NullLexerAction>
-class LexerObject : public TType
-{
-public:
-    LexerObject(Lexer *lexer, State<typename TType::Type> *sourceState = {})
-        : TType(sourceState)
-        , m_lexer(lexer)
-    {
-    }
-
-    bool characterTest(QString::const_iterator character)
-    {
-        return Test::characterTest(character);
-    }
-
-    void onTransition()
-    {
-        Action1::doAction(m_lexer);
-    }
-
-    void onEntry()
-    {
-        Action1::doAction(m_lexer);
-    }
-
-    void onExit()
-    {
-        Action2::doAction(m_lexer);
-    }
-
-private:
-    Lexer *const m_lexer;
-};
-
-struct TokenFinalizer {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->finalizeToken();
-    }
-};
-
-struct TokenFinalizerWithTrimming {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->finalizeTokenWithTrimmedWhitespace();
-    }
-};
-
-struct TokenFinalizerWithTrimmingAndNewline {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->finalizeTokenWithTrimmedWhitespace();
-        lexer->markNewline();
-    }
-};
-
-struct MarkStartSyntax {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->markStartSyntax();
-    }
-};
-
-struct FinalizeAndMarkStartSyntax {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->finalizeToken();
-        lexer->markStartSyntax();
-    }
-};
-
-struct MarksClearer {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->clearMarkers();
-    }
-};
-
-struct MarkEndSyntax {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->markEndSyntax();
-    }
-};
-
-struct MarkNewline {
-    static void doAction(Lexer *lexer)
-    {
-        lexer->markNewline();
-    }
-};
-
-template<char c, typename Action = NullLexerAction>
-class CharacterTransition : public LexerObject<State<CharTransitionInterface>::Transition, CharacterTest<c>, Action>
-{
-public:
-    CharacterTransition(Lexer *lexer, State<CharTransitionInterface> *sourceState = {})
-        : LexerObject<State<CharTransitionInterface>::Transition, CharacterTest<c>, Action>(lexer, sourceState)
-    {
-    }
-};
-
-template<char c, typename Action = NullLexerAction>
-class NegateCharacterTransition : public LexerObject<State<CharTransitionInterface>::Transition, Negate<CharacterTest<c>>, Action>
-{
-public:
-    NegateCharacterTransition(Lexer *lexer, State<CharTransitionInterface> *sourceState = {})
-        : LexerObject<State<CharTransitionInterface>::Transition, Negate<CharacterTest<c>>, Action>(lexer, sourceState)
-    {
-    }
+    int m_tokenOffset;
 };
 }
 
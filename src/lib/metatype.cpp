@@ -12,11 +12,15 @@
 
 #include "customtyperegistry_p.h"
 #include "metaenumvariable_p.h"
+#include "valuetype_p.h"
 
 #include <QAssociativeIterable>
 #include <QDebug>
+#include <QReadWriteLock>
 #include <QSequentialIterable>
 
+#include <optional>
+
 using namespace KTextTemplate;
 
 Q_GLOBAL_STATIC(CustomTypeRegistry, customTypes)
@@ -39,6 +43,85 @@ void KTextTemplate::MetaType::registerLookUpOperator(int id, LookupFunction f)
     customTypes()->registerLookupOperator(id, f);
 }
 
+namespace
+{
+// What a name refers to on a QMetaObject.
+struct MetaMember {
+    enum Kind : quint8 {
+        None,
+        Property,
+        Enumerator,
+        EnumKey,
+    };
+    Kind kind = None;
+    // The index of the property or enumerator.
+    int index = -1;
+    // The value of the key of the enumerator.
+    int value = -1;
+};
+
+using MetaMembers = QHash<const QMetaObject *, QHash<QString, MetaMember>>;
+
+// The members found by name for each QMetaObject, which are resolved the first
+// time a name is looked up on it and then shared by all threads.
+struct MetaMemberCache {
+    QReadWriteLock lock;
+    MetaMembers members;
+};
+Q_GLOBAL_STATIC(MetaMemberCache, s_metaMembers)
+
+// The members this thread already used, which are found without a lock.
+thread_local MetaMembers s_threadMetaMembers;
+}
+
+static MetaMember resolveMember(const QMetaObject *metaObj, const QString &name)
+{
+    for (auto i = 0; i < metaObj->propertyCount(); ++i) {
+        // TODO only read-only properties should be allowed here.
+        // This might also handle the variant messing I hit before.
+        if (QString::fromUtf8(metaObj->property(i).name()) == name)
+            return {MetaMember::Property, i};
+    }
+    const auto key = name.toLatin1();
+    for (auto i = 0; i < metaObj->enumeratorCount(); ++i) {
+        const auto me = metaObj->enumerator(i);
+
+        if (QLatin1String(me.name()) == name)
+            return {MetaMember::Enumerator, i};
+
+        const auto value = me.keyToValue(key.constData());
+        if (value >= 0)
+            return {MetaMember::EnumKey, i, value};
+    }
+    return {};
+}
+
+static MetaMember findMember(const QMetaObject *metaObj, const QString &name)
+{
+    auto &threadMembers = s_threadMetaMembers[metaObj];
+    if (const auto it = threadMembers.constFind(name); it != threadMembers.constEnd())
+        return it.value();
+
+    const auto cache = s_metaMembers();
+    std::optional<MetaMember> member;
+    {
+        const QReadLocker locker(&cache->lock);
+        const auto members = cache->members.constFind(metaObj);
+        if (members != cache->members.constEnd()) {
+            if (const auto it = members->constFind(name); it != members->constEnd())
+                member = it.value();
+        }
+    }
+    if (!member) {
+        member = resolveMember(metaObj, name);
+        const QWriteLocker locker(&cache->lock);
+        cache->members[metaObj].insert(name, *member);
+    }
+
+    threadMembers.insert(name, *member);
+    return *member;
+}
+
 static QVariant doQobjectLookUp(const QObject *const object, const QString &property)
 {
     if (!object)
@@ -59,52 +142,36 @@ static QVariant doQobjectLookUp(const QObject *const object, const QString &prop
     if (property == QStringLiteral("objectName")) {
         return object->objectName();
     }
-    // Can't be const because of invokeMethod.
-    auto metaObj = object->metaObject();
-
-    QMetaProperty mp;
-    for (auto i = 0; i < metaObj->propertyCount(); ++i) {
-        // TODO only read-only properties should be allowed here.
-        // This might also handle the variant messing I hit before.
-        mp = metaObj->property(i);
-
-        if (QString::fromUtf8(mp.name()) != property)
-            continue;
 
+    const auto metaObj = object->metaObject();
+    const auto member = findMember(metaObj, property);
+    switch (member.kind) {
+    case MetaMember::Property: {
+        const auto mp = metaObj->property(member.index);
         if (mp.isEnumType()) {
             MetaEnumVariable mev(mp.enumerator(), mp.read(object).value<int>());
             return QVariant::fromValue(mev);
         }
-
         return mp.read(object);
     }
-    QMetaEnum me;
-    for (auto i = 0; i < metaObj->enumeratorCount(); ++i) {
-        me = metaObj->enumerator(i);
-
-        if (QLatin1String(me.name()) == property) {
-            MetaEnumVariable mev(me);
-            return QVariant::fromValue(mev);
-        }
-
-        const auto value = me.keyToValue(property.toLatin1().constData());
-
-        if (value < 0)
-            continue;
-
-        const MetaEnumVariable mev(me, value);
-
-        return QVariant::fromValue(mev);
+    case MetaMember::Enumerator:
+        return QVariant::fromValue(MetaEnumVariable(metaObj->enumerator(member.index)));
+    case MetaMember::EnumKey:
+        return QVariant::fromValue(MetaEnumVariable(metaObj->enumerator(member.index), member.value));
+    case MetaMember::None:
+        break;
     }
+    // Dynamic properties differ between objects, so they are not cached.
     return object->property(property.toUtf8().constData());
 }
 
 QVariant KTextTemplate::MetaType::lookup(const QVariant &object, const QString &property)
 {
-    if (object.canConvert<QObject *>()) {
+    const auto kind = ValueType::of(object);
+    if (kind == ValueType::Object) {
         return doQobjectLookUp(object.value<QObject *>(), property);
     }
-    if (object.canConvert<QVariantList>()) {
+    if (kind == ValueType::List) {
         auto iter = object.value<QSequentialIterable>();
         if (property == QStringLiteral("size") || property == QStringLiteral("count")) {
             return iter.size();
@@ -119,7 +186,7 @@ QVariant KTextTemplate::MetaType::lookup(const QVariant &object, const QString &
 
         return iter.at(listIndex);
     }
-    if (object.canConvert<QVariantHash>()) {
+    if (kind == ValueType::Hash) {
         auto iter = object.value<QAssociativeIterable>();
 
         if (iter.find(property) != iter.end()) {
@@ -162,40 +229,24 @@ QVariant KTextTemplate::MetaType::lookup(const QVariant &object, const QString &
 
         return {};
     }
-    auto mo = QMetaType(object.userType()).metaObject();
-    if (mo) {
-        QMetaType mt(object.userType());
-        if (mt.flags().testFlag(QMetaType::IsGadget)) {
-            const auto idx = mo->indexOfProperty(property.toUtf8().constData());
-            if (idx >= 0) {
-                const auto mp = mo->property(idx);
-
-                if (mp.isEnumType()) {
-                    MetaEnumVariable mev(mp.enumerator(), mp.readOnGadget(object.constData()).value<int>());
-                    return QVariant::fromValue(mev);
-                }
-
-                return mp.readOnGadget(object.constData());
-            }
-
-            QMetaEnum me;
-            for (auto i = 0; i < mo->enumeratorCount(); ++i) {
-                me = mo->enumerator(i);
-
-                if (QLatin1String(me.name()) == property) {
-                    MetaEnumVariable mev(me);
-                    return QVariant::fromValue(mev);
-                }
-
-                const auto value = me.keyToValue(property.toLatin1().constData());
-
-                if (value < 0) {
-                    continue;
-                }
-
-                MetaEnumVariable mev(me, value);
+    if (kind == ValueType::Gadget) {
+        const auto mo = object.metaType().metaObject();
+        const auto member = findMember(mo, property);
+        switch (member.kind) {
+        case MetaMember::Property: {
+            const auto mp = mo->property(member.index);
+            if (mp.isEnumType()) {
+                MetaEnumVariable mev(mp.enumerator(), mp.readOnGadget(object.constData()).value<int>());
                 return QVariant::fromValue(mev);
             }
+            return mp.readOnGadget(object.constData());
+        }
+        case MetaMember::Enumerator:
+            return QVariant::fromValue(MetaEnumVariable(mo->enumerator(member.index)));
+        case MetaMember::EnumKey:
+            return QVariant::fromValue(MetaEnumVariable(mo->enumerator(member.index), member.value));
+        case MetaMember::None:
+            break;
         }
     }
 
@@ -9,10 +9,13 @@
 
 #include "node.h"
 
+#include "exception.h"
 #include "metaenumvariable_p.h"
 #include "nodebuiltins_p.h"
+#include "rendercontext.h"
 #include "template.h"
 #include "util.h"
+#include "valuetype_p.h"
 
 #include <QRegularExpressionMatchIterator>
 
@@ -29,6 +32,8 @@ class NodePrivate
     }
     Q_DECLARE_PUBLIC(Node)
     Node *const q_ptr;
+
+    int m_lineNumber = -1;
 };
 
 class AbstractNodeFactoryPrivate
@@ -88,9 +93,12 @@ Node::~Node()
 void Node::streamValueInContext(OutputStream *stream, const QVariant &input, Context *c) const
 {
     KTextTemplate::SafeString inputString;
-    if (input.userType() == qMetaTypeId<QVariantList>()) {
+    const auto kind = ValueType::of(input);
+    if (kind == ValueType::SafeString) {
+        inputString = *static_cast<const KTextTemplate::SafeString *>(input.constData());
+    } else if (input.userType() == qMetaTypeId<QVariantList>()) {
         inputString = toString(input.value<QVariantList>());
-    } else if (input.userType() == qMetaTypeId<MetaEnumVariable>()) {
+    } else if (kind == ValueType::Enum) {
         const auto mev = input.value<MetaEnumVariable>();
         if (mev.value >= 0)
             (*stream) << QString::number(mev.value);
@@ -181,10 +189,32 @@ bool NodeList::containsNonText() const
 void NodeList::render(OutputStream *stream, Context *c) const
 {
     for (auto i = 0; i < this->size(); ++i) {
-        this->at(i)->render(stream, c);
+        const auto node = this->at(i);
+        try {
+            node->render(stream, c);
+        } catch (const KTextTemplate::Exception &) {
+            // The innermost node with a known location is reported.
+            if (node->lineNumber() >= 0) {
+                const auto t = node->containerTemplate();
+                c->renderContext()->setErrorLocation(t ? t->objectName() : QString(), node->lineNumber());
+            }
+            throw;
+        }
     }
 }
 
+int Node::lineNumber() const
+{
+    Q_D(const Node);
+    return d->m_lineNumber;
+}
+
+void Node::setLineNumber(int lineNumber)
+{
+    Q_D(Node);
+    d->m_lineNumber = lineNumber;
+}
+
 AbstractNodeFactory::AbstractNodeFactory(QObject *parent)
     : QObject(parent)
     , d_ptr(new AbstractNodeFactoryPrivate(this))
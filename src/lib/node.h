@@ -84,6 +84,10 @@ public:
       Reimplement this to render the template in the Context \a c.
 
       This will also involve calling render on and child nodes.
+
+      A Template may be rendered by several threads at once, so
+      implementations should not modify the node. State which must be kept
+      while rendering belongs in the \l {Context::renderContext()} {RenderContext}.
     */
     virtual void render(OutputStream *stream, Context *c) const = 0;
 
@@ -110,6 +114,15 @@ protected:
     TemplateImpl *containerTemplate() const;
 
 private:
+    // The line of the token the node was parsed from, used to locate errors
+    // while rendering.
+    int lineNumber() const;
+    void setLineNumber(int lineNumber);
+
+    friend class NodeList;
+    friend class ParserPrivate;
+    friend class TemplatePrivate;
+
     Q_DECLARE_PRIVATE(Node)
     NodePrivate *const d_ptr;
 };
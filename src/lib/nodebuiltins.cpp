@@ -9,6 +9,9 @@
 
 #include "nodebuiltins_p.h"
 
+#include "context.h"
+#include "valuetype_p.h"
+
 using namespace KTextTemplate;
 
 TextNode::TextNode(const QString &content, QObject *parent)
@@ -23,12 +26,30 @@ VariableNode::VariableNode(const FilterExpression &fe, QObject *parent)
 {
 }
 
+FilterExpression VariableNode::filterExpression() const
+{
+    return m_filterExpression;
+}
+
 void VariableNode::render(OutputStream *stream, Context *c) const
 {
-    const auto v = m_filterExpression.resolve(c);
-    if (!v.isValid())
+    const auto value = m_filterExpression.resolveValue(c);
+    switch (value.type()) {
+    case RenderValue::Invalid:
+        return;
+    case RenderValue::Object:
+    case RenderValue::Variant:
+        streamValueInContext(stream, value.toVariant(), c);
         return;
-    streamValueInContext(stream, v, c);
+    default:
+        break;
+    }
+
+    // As streamValueInContext renders strings and scalars.
+    auto string = value.toSafeString();
+    if (c->autoEscape() && !string.isSafe())
+        string.setNeedsEscape(true);
+    (*stream) << string;
 }
 
 #include "moc_nodebuiltins_p.cpp"
@@ -20,6 +20,9 @@ namespace KTextTemplate
 
   A Node for plain text. Plain text is everything between variables, comments
   and template tags.
+
+  The content of a TextNode created by the Parser references the source of its
+  containing Template rather than holding a copy.
 */
 class KTEXTTEMPLATE_EXPORT TextNode : public Node
 {
@@ -48,6 +51,8 @@ class KTEXTTEMPLATE_EXPORT VariableNode : public Node
 public:
     explicit VariableNode(const FilterExpression &fe, QObject *parent = {});
 
+    FilterExpression filterExpression() const;
+
     void render(OutputStream *stream, Context *c) const override;
 
 private:
@@ -8,6 +8,7 @@
 */
 
 #include "parser.h"
+#include "parser_p.h"
 
 #include "engine.h"
 #include "exception.h"
@@ -17,39 +18,6 @@
 
 using namespace KTextTemplate;
 
-namespace KTextTemplate
-{
-
-class ParserPrivate
-{
-public:
-    ParserPrivate(Parser *parser, const QList<Token> &tokenList)
-        : q_ptr(parser)
-        , m_tokenList(tokenList)
-    {
-    }
-
-    NodeList extendNodeList(NodeList list, Node *node);
-
-    /*
-      Parses the template to create a Nodelist.
-      The given parent is the parent of each node in the returned list.
-    */
-    NodeList parse(QObject *parent, const QStringList &stopAt);
-
-    void openLibrary(TagLibraryInterface *library);
-    Q_DECLARE_PUBLIC(Parser)
-    Parser *const q_ptr;
-
-    QList<Token> m_tokenList;
-
-    QHash<QString, AbstractNodeFactory *> m_nodeFactories;
-    QHash<QString, QSharedPointer<Filter>> m_filters;
-
-    NodeList m_nodeList;
-};
-}
-
 void ParserPrivate::openLibrary(TagLibraryInterface *library)
 {
     Q_Q(Parser);
@@ -113,6 +81,27 @@ void Parser::loadLib(const QString &name)
     if (!library)
         return;
     d->openLibrary(library);
+    d->m_loadedLibraries.append(name);
+}
+
+ParserState ParserPrivate::state() const
+{
+    Q_Q(const Parser);
+    ParserState state;
+    state.libraries = m_loadedLibraries;
+    const auto names = q->dynamicPropertyNames();
+    for (const auto &name : names)
+        state.properties.insert(name, q->property(name.constData()));
+    return state;
+}
+
+void ParserPrivate::restoreState(const ParserState &state)
+{
+    Q_Q(Parser);
+    for (const auto &library : state.libraries)
+        q->loadLib(library);
+    for (const auto &[name, value] : state.properties.asKeyValueRange())
+        q->setProperty(name.constData(), value);
 }
 
 NodeList ParserPrivate::extendNodeList(NodeList list, Node *node)
@@ -128,8 +117,9 @@ NodeList ParserPrivate::extendNodeList(NodeList list, Node *node)
 
 void Parser::skipPast(const QString &tag)
 {
+    Q_D(Parser);
     while (hasNextToken()) {
-        const auto token = takeNextToken();
+        const auto token = d->takeToken();
         if (token.tokenType == BlockToken && token.content == tag)
             return;
     }
@@ -169,8 +159,18 @@ NodeList ParserPrivate::parse(QObject *parent, const QStringList &stopAt)
     Q_Q(Parser);
     NodeList nodeList;
 
+    // Top-level nodes are recorded for incremental compilation.
+    const auto recordNodes = m_parsedNodes && parent == q->parent();
+
     while (q->hasNextToken()) {
-        const auto token = q->takeNextToken();
+        const auto firstToken = m_consumedTokens;
+        ParserState stateBefore;
+        if (recordNodes)
+            stateBefore = state();
+
+        // Text tokens are not copied, the TextNode keeps referencing the template
+        // source.
+        const auto token = takeToken();
         if (token.tokenType == TextToken) {
             nodeList = extendNodeList(nodeList, new TextNode(token.content, parent));
         } else if (token.tokenType == VariableToken) {
@@ -193,7 +193,9 @@ NodeList ParserPrivate::parse(QObject *parent, const QStringList &stopAt)
                                                QStringLiteral("%1, line %2, %3").arg(e.what()).arg(token.linenumber).arg(q->parent()->objectName()));
             }
 
-            nodeList = extendNodeList(nodeList, new VariableNode(filterExpression, parent));
+            auto n = new VariableNode(filterExpression, parent);
+            n->setLineNumber(token.linenumber);
+            nodeList = extendNodeList(nodeList, n);
         } else {
             Q_ASSERT(token.tokenType == BlockToken);
             const auto command = token.content.section(QLatin1Char(' '), 0, 0);
@@ -237,9 +239,13 @@ NodeList ParserPrivate::parse(QObject *parent, const QStringList &stopAt)
             }
 
             n->setParent(parent);
+            n->setLineNumber(token.linenumber);
 
             nodeList = extendNodeList(nodeList, n);
         }
+
+        if (recordNodes)
+            m_parsedNodes->append({firstToken, m_consumedTokens - firstToken, stateBefore});
     }
 
     if (!stopAt.isEmpty()) {
@@ -260,12 +266,18 @@ bool Parser::hasNextToken() const
 Token Parser::takeNextToken()
 {
     Q_D(Parser);
-    return d->m_tokenList.takeFirst();
+    auto token = d->takeToken();
+    // Text tokens created by the Lexer reference the template source. Tags may
+    // keep the token around for longer than the template, so hand out a copy.
+    if (token.tokenType == TextToken)
+        token.content = QString(token.content.constData(), token.content.size());
+    return token;
 }
 
 void Parser::removeNextToken()
 {
     Q_D(Parser);
+    ++d->m_consumedTokens;
     d->m_tokenList.removeFirst();
 }
 
@@ -286,6 +298,7 @@ void Parser::invalidBlockTag(const Token &token, const QString &command, const Q
 void Parser::prependToken(const Token &token)
 {
     Q_D(Parser);
+    --d->m_consumedTokens;
     d->m_tokenList.prepend(token);
 }
 
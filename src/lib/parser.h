@@ -21,6 +21,7 @@ namespace KTextTemplate
 class TemplateImpl;
 
 class ParserPrivate;
+class TemplatePrivate;
 
 /// @headerfile parser.h <KTextTemplate/Parser>
 
@@ -121,6 +122,7 @@ protected:
 private:
     Q_DECLARE_PRIVATE(Parser)
     ParserPrivate *const d_ptr;
+    friend class TemplatePrivate;
 };
 }
 
@@ -0,0 +1,89 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2009, 2010 Stephen Kelly <steveire@gmail.com>
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#ifndef KTEXTTEMPLATE_PARSER_P_H
+#define KTEXTTEMPLATE_PARSER_P_H
+
+#include "parser.h"
+
+#include <QHash>
+#include <QVariant>
+
+namespace KTextTemplate
+{
+
+class TagLibraryInterface;
+
+/*
+  The state a Parser carries from one top-level node to the next: libraries
+  loaded with the \c {% load %} tag, and the dynamic properties tags use to
+  keep track of the parse.
+*/
+struct ParserState {
+    QStringList libraries;
+    QHash<QByteArray, QVariant> properties;
+
+    bool operator==(const ParserState &other) const = default;
+};
+
+/*
+  A top-level node of a Template and the range of tokens it was parsed from.
+*/
+struct ParsedNode {
+    int firstToken;
+    int tokenCount;
+    ParserState state; ///< The state of the Parser before the node was parsed
+};
+
+class ParserPrivate
+{
+public:
+    ParserPrivate(Parser *parser, const QList<Token> &tokenList)
+        : q_ptr(parser)
+        , m_tokenList(tokenList)
+    {
+    }
+
+    NodeList extendNodeList(NodeList list, Node *node);
+
+    /*
+      Parses the template to create a Nodelist.
+      The given parent is the parent of each node in the returned list.
+    */
+    NodeList parse(QObject *parent, const QStringList &stopAt);
+
+    void openLibrary(TagLibraryInterface *library);
+
+    Token takeToken()
+    {
+        ++m_consumedTokens;
+        return m_tokenList.takeFirst();
+    }
+
+    ParserState state() const;
+    void restoreState(const ParserState &state);
+
+    Q_DECLARE_PUBLIC(Parser)
+    Parser *const q_ptr;
+
+    QList<Token> m_tokenList;
+
+    QHash<QString, AbstractNodeFactory *> m_nodeFactories;
+    QHash<QString, QSharedPointer<Filter>> m_filters;
+
+    NodeList m_nodeList;
+
+    // Used for incremental compilation of templates.
+    int m_consumedTokens = 0;
+    QStringList m_loadedLibraries;
+    QList<ParsedNode> *m_parsedNodes = nullptr;
+};
+}
+
+#endif
@@ -27,6 +27,10 @@ class RenderContextPrivate
     RenderContext *const q_ptr;
 
     QList<QHash<const Node *, QVariant>> m_variantHashStack;
+
+    bool m_hasErrorLocation = false;
+    QString m_errorTemplateName;
+    int m_errorLineNumber = -1;
 };
 }
 
@@ -65,3 +69,47 @@ void RenderContext::pop()
     Q_D(RenderContext);
     d->m_variantHashStack.removeFirst();
 }
+
+bool RenderContext::isEmpty() const
+{
+    Q_D(const RenderContext);
+    return d->m_variantHashStack.isEmpty();
+}
+
+void RenderContext::clearErrorLocation()
+{
+    Q_D(RenderContext);
+    d->m_hasErrorLocation = false;
+    d->m_errorTemplateName.clear();
+    d->m_errorLineNumber = -1;
+}
+
+void RenderContext::setErrorLocation(const QString &templateName, int lineNumber)
+{
+    Q_D(RenderContext);
+    // The exception propagates through the enclosing nodes, which must not
+    // overwrite the location of the node which threw it.
+    if (d->m_hasErrorLocation)
+        return;
+    d->m_hasErrorLocation = true;
+    d->m_errorTemplateName = templateName;
+    d->m_errorLineNumber = lineNumber;
+}
+
+bool RenderContext::hasErrorLocation() const
+{
+    Q_D(const RenderContext);
+    return d->m_hasErrorLocation;
+}
+
+QString RenderContext::errorTemplateName() const
+{
+    Q_D(const RenderContext);
+    return d->m_errorTemplateName;
+}
+
+int RenderContext::errorLineNumber() const
+{
+    Q_D(const RenderContext);
+    return d->m_errorLineNumber;
+}
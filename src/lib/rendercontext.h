@@ -56,9 +56,21 @@ private:
 
     void pop();
 
+    bool isEmpty() const;
+
+    // The location of the node which failed to render, see
+    // TemplateImpl::tryRender().
+    void clearErrorLocation();
+    void setErrorLocation(const QString &templateName, int lineNumber);
+    bool hasErrorLocation() const;
+    QString errorTemplateName() const;
+    int errorLineNumber() const;
+
 private:
     friend class ContextPrivate;
+    friend class NodeList;
     friend class TemplateImpl;
+    friend class TemplatePrivate;
 
     Q_DISABLE_COPY(RenderContext)
     Q_DECLARE_PRIVATE(RenderContext)
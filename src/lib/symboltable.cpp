@@ -0,0 +1,98 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include "symboltable_p.h"
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+#include <QSet>
+
+#include <atomic>
+
+using namespace KTextTemplate;
+
+namespace
+{
+struct Symbols {
+    QReadWriteLock lock;
+    QHash<QString, int> symbols;
+    QList<QString> names;
+    // Changes each time a name is interned.
+    std::atomic<quint64> generation = 0;
+};
+Q_GLOBAL_STATIC(Symbols, s_symbols)
+
+// The symbols this thread already used, which are looked up without a lock.
+thread_local QHash<QString, int> s_threadSymbols;
+
+// The names this thread did not find, which stay valid until a name is
+// interned. Names which only come from data are missed each time, so the set
+// is capped rather than growing with the data.
+thread_local QSet<QString> s_threadMisses;
+thread_local quint64 s_threadMissesGeneration = 0;
+constexpr qsizetype MaxThreadMisses = 1024;
+}
+
+int SymbolTable::intern(const QString &name)
+{
+    if (const auto symbol = find(name); symbol != NoSymbol)
+        return symbol;
+
+    const auto symbols = s_symbols();
+    QWriteLocker locker(&symbols->lock);
+    auto it = symbols->symbols.constFind(name);
+    if (it == symbols->symbols.constEnd()) {
+        it = symbols->symbols.insert(name, int(symbols->names.size()));
+        symbols->names.append(name);
+        symbols->generation.fetch_add(1, std::memory_order_release);
+    }
+    const auto symbol = it.value();
+    locker.unlock();
+
+    s_threadSymbols.insert(name, symbol);
+    return symbol;
+}
+
+int SymbolTable::find(const QString &name)
+{
+    if (const auto it = s_threadSymbols.constFind(name); it != s_threadSymbols.constEnd())
+        return it.value();
+
+    const auto symbols = s_symbols();
+    // Read before the lookup, so that a miss recorded for a name interned
+    // meanwhile is dropped by the next find().
+    const auto generation = symbols->generation.load(std::memory_order_acquire);
+    if (generation != s_threadMissesGeneration) {
+        s_threadMisses.clear();
+        s_threadMissesGeneration = generation;
+    } else if (s_threadMisses.contains(name)) {
+        return NoSymbol;
+    }
+
+    QReadLocker locker(&symbols->lock);
+    const auto symbol = symbols->symbols.value(name, NoSymbol);
+    locker.unlock();
+
+    if (symbol != NoSymbol) {
+        s_threadSymbols.insert(name, symbol);
+    } else {
+        if (s_threadMisses.size() >= MaxThreadMisses)
+            s_threadMisses.clear();
+        s_threadMisses.insert(name);
+    }
+    return symbol;
+}
+
+QString SymbolTable::name(int symbol)
+{
+    const auto symbols = s_symbols();
+    const QReadLocker locker(&symbols->lock);
+    return symbols->names.value(symbol);
+}
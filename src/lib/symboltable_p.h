@@ -0,0 +1,48 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#ifndef KTEXTTEMPLATE_SYMBOLTABLE_P_H
+#define KTEXTTEMPLATE_SYMBOLTABLE_P_H
+
+#include <QString>
+
+namespace KTextTemplate
+{
+
+/*
+  Interns the names of context variables as small integers, so that the
+  Context stores and finds variables without hashing their names.
+
+  Only Variables intern their names, when they are parsed. The Context finds
+  the symbols of the names inserted into it, and keeps the values of names
+  which were never interned by name. Names are interned for the whole process
+  rather than for each Engine, as a Context is not tied to an Engine, and are
+  never released, so names which only come from data are not interned.
+*/
+class SymbolTable
+{
+public:
+    enum { NoSymbol = -1 };
+
+    /*
+      Returns the symbol of \a name, interning it first if necessary.
+    */
+    static int intern(const QString &name);
+
+    /*
+      Returns the symbol of \a name, or NoSymbol if it was never interned, in
+      which case no Context can have a value for it.
+    */
+    static int find(const QString &name);
+
+    static QString name(int symbol);
+};
+}
+
+#endif
@@ -13,22 +13,245 @@
 #include "context.h"
 #include "engine.h"
 #include "lexer_p.h"
+#include "nodebuiltins_p.h"
 #include "parser.h"
 #include "rendercontext.h"
 
 #include <QLoggingCategory>
 
+#include <algorithm>
+
 Q_LOGGING_CATEGORY(KTEXTTEMPLATE_TEMPLATE, "kf.texttemplate")
 
 using namespace KTextTemplate;
 
-NodeList TemplatePrivate::compileString(const QString &str)
+namespace
+{
+// The top-level nodes of a parse become children of the template as they are
+// parsed, after its existing children. Unless the parse is kept, this deletes
+// those already parsed when it is destroyed, so that a failed parse leaves no
+// orphaned nodes behind.
+class ParsedNodesGuard
+{
+public:
+    explicit ParsedNodesGuard(QObject *t)
+        : m_template(t)
+        , m_existingChildren(t->children().size())
+    {
+    }
+
+    ~ParsedNodesGuard()
+    {
+        if (m_kept)
+            return;
+        const auto children = m_template->children();
+        for (auto i = m_existingChildren; i < children.size(); ++i) {
+            if (qobject_cast<Node *>(children.at(i)))
+                delete children.at(i);
+        }
+    }
+
+    void keep()
+    {
+        m_kept = true;
+    }
+
+private:
+    QObject *const m_template;
+    const qsizetype m_existingChildren;
+    bool m_kept = false;
+};
+}
+
+void TemplatePrivate::compileString(const QString &str)
+{
+    Q_Q(TemplateImpl);
+    ParsedNodesGuard guard(q);
+    // The source is only replaced once the parse succeeds, as the nodes of
+    // the previous content reference its data until then.
+    const auto source = str;
+    NodeList nodeList;
+    {
+        Lexer l(source);
+        Parser p(l.tokenize(m_smartTrim ? Lexer::SmartTrim : Lexer::NoSmartTrim), q);
+        nodeList = p.parse(q);
+    }
+    guard.keep();
+
+    m_nodeList = nodeList;
+    ++m_generation;
+    m_source = source;
+    clearIncrementalState();
+}
+
+void TemplatePrivate::clearIncrementalState()
+{
+    m_incremental = false;
+    m_compiledNodes.clear();
+    m_checkpoints.clear();
+    m_tokenCount = 0;
+}
+
+void TemplatePrivate::compileTokens(const QList<Token> &tokens)
+{
+    Q_Q(TemplateImpl);
+    ParsedNodesGuard guard(q);
+    try {
+        {
+            Parser p(tokens, q);
+            m_nodeList = p.parse(q);
+            ++m_generation;
+        }
+        guard.keep();
+        clearIncrementalState();
+        setCompileError(NoError, QString());
+    } catch (KTextTemplate::Exception &e) {
+        qCWarning(KTEXTTEMPLATE_TEMPLATE) << e.what();
+        setCompileError(e.errorCode(), e.what());
+    }
+}
+
+void TemplatePrivate::compileIncrementally(const QString &str)
 {
     Q_Q(TemplateImpl);
+    const auto trimType = m_smartTrim ? Lexer::SmartTrim : Lexer::NoSmartTrim;
+
+    QList<LexerCheckpoint> checkpoints{Lexer::initialCheckpoint(trimType)};
     Lexer l(str);
-    Parser p(l.tokenize(m_smartTrim ? Lexer::SmartTrim : Lexer::NoSmartTrim), q);
+    const auto tokens = l.tokenize(trimType, checkpoints.first(), &checkpoints);
+
+    QList<ParsedNode> parsedNodes;
+    NodeList nodeList;
+    ParserState finalState;
+    ParsedNodesGuard guard(q);
+    {
+        Parser p(tokens, q);
+        p.d_func()->m_parsedNodes = &parsedNodes;
+        nodeList = p.parse(q);
+        finalState = p.d_func()->state();
+    }
+    guard.keep();
+
+    clearNodes();
 
-    return p.parse(q);
+    m_nodeList = nodeList;
+    ++m_generation;
+    m_source = str;
+    m_checkpoints = checkpoints;
+    for (const auto &parsed : std::as_const(parsedNodes))
+        m_compiledNodes.append({parsed, str});
+    m_finalParserState = finalState;
+    m_tokenCount = tokens.size();
+    m_incremental = true;
+}
+
+bool TemplatePrivate::recompile(int position, int removed, int added, const QString &str)
+{
+    Q_Q(TemplateImpl);
+    const auto trimType = m_smartTrim ? Lexer::SmartTrim : Lexer::NoSmartTrim;
+
+    const auto nodeContaining = [this](int token) {
+        const auto it = std::upper_bound(m_compiledNodes.cbegin(), m_compiledNodes.cend(), token, [](int t, const CompiledNode &node) {
+            return t < node.parsed.firstToken;
+        });
+        Q_ASSERT(it != m_compiledNodes.cbegin());
+        return std::prev(it);
+    };
+    const auto nodeStart = [&](int token) {
+        return nodeContaining(token)->parsed.firstToken;
+    };
+    const auto nodeEnd = [&](int token) {
+        const auto node = nodeContaining(token);
+        return node->parsed.firstToken + node->parsed.tokenCount;
+    };
+
+    Lexer l(str);
+    const auto update = l.retokenize(trimType, m_checkpoints, m_tokenCount, position, removed, added, nodeStart, nodeEnd);
+
+    // The changed tokens are those of the nodes in [firstNode, endNode).
+    const auto firstNode = nodeContaining(update.firstToken) - m_compiledNodes.cbegin();
+    const auto endNode = update.previousTokenEnd == m_tokenCount ? m_compiledNodes.size() : nodeContaining(update.previousTokenEnd) - m_compiledNodes.cbegin();
+
+    const auto &stateBefore = m_compiledNodes.at(firstNode).parsed.state;
+    const auto &stateAfter = endNode < m_compiledNodes.size() ? m_compiledNodes.at(endNode).parsed.state : m_finalParserState;
+
+    QList<ParsedNode> parsedNodes;
+    NodeList nodes;
+    ParsedNodesGuard guard(q);
+    try {
+        Parser p(update.tokens, q);
+        auto pd = p.d_func();
+        pd->restoreState(stateBefore);
+        pd->m_consumedTokens = update.firstToken;
+        pd->m_parsedNodes = &parsedNodes;
+        nodes = p.parse(q);
+
+        // The following nodes may only be reused if they would be parsed in
+        // the same state.
+        if (pd->state() != stateAfter)
+            return false;
+    } catch (const KTextTemplate::Exception &) {
+        // The error may be an artifact of parsing only part of the template,
+        // such as a tag which is closed in a later node. The full compilation
+        // reports the actual error.
+        return false;
+    }
+
+    QList<Node *> nodeList = m_nodeList.mid(0, firstNode) + nodes + m_nodeList.mid(endNode);
+
+    auto containsNonText = false;
+    for (const auto node : std::as_const(nodeList)) {
+        if (node->mustBeFirst() && containsNonText)
+            return false;
+        if (!qobject_cast<TextNode *>(node))
+            containsNonText = true;
+    }
+    guard.keep();
+
+    const auto tokenDelta = static_cast<int>(update.tokens.size()) - (update.previousTokenEnd - update.firstToken);
+
+    auto compiledNodes = m_compiledNodes.mid(0, firstNode);
+    for (const auto &parsed : std::as_const(parsedNodes))
+        compiledNodes.append({parsed, str});
+    for (auto i = endNode; i < m_compiledNodes.size(); ++i) {
+        auto compiledNode = m_compiledNodes.at(i);
+        compiledNode.parsed.firstToken += tokenDelta;
+        compiledNodes.append(compiledNode);
+    }
+
+    qDeleteAll(m_nodeList.mid(firstNode, endNode - firstNode));
+
+    if (update.lineDelta != 0) {
+        for (auto i = endNode; i < m_compiledNodes.size(); ++i) {
+            auto node = m_nodeList.at(i);
+            auto nodes = node->findChildren<Node *>();
+            nodes.append(node);
+            for (auto n : std::as_const(nodes)) {
+                if (n->lineNumber() >= 0)
+                    n->setLineNumber(n->lineNumber() + update.lineDelta);
+            }
+        }
+    }
+
+    m_nodeList = NodeList(nodeList);
+    ++m_generation;
+    m_source = str;
+    m_checkpoints = update.checkpoints;
+    m_compiledNodes = compiledNodes;
+    m_tokenCount += tokenDelta;
+    return true;
+}
+
+void TemplatePrivate::clearNodes()
+{
+    Q_Q(TemplateImpl);
+    for (const auto node : std::as_const(m_nodeList)) {
+        if (node->parent() == q)
+            delete node;
+    }
+    m_nodeList = NodeList();
+    ++m_generation;
+    clearIncrementalState();
 }
 
 TemplateImpl::TemplateImpl(Engine const *engine, QObject *parent)
@@ -55,11 +278,11 @@ void TemplateImpl::setContent(const QString &templateString)
         return;
 
     try {
-        d->m_nodeList = d->compileString(templateString);
-        d->setError(NoError, QString());
+        d->compileString(templateString);
+        d->setCompileError(NoError, QString());
     } catch (KTextTemplate::Exception &e) {
         qCWarning(KTEXTTEMPLATE_TEMPLATE) << e.what();
-        d->setError(e.errorCode(), e.what());
+        d->setCompileError(e.errorCode(), e.what());
     }
 }
 
@@ -76,21 +299,69 @@ OutputStream *TemplateImpl::render(OutputStream *stream, Context *c) const
 {
     Q_D(const Template);
 
+    const auto result = d->render(stream, c);
+    if (result.error())
+        qCWarning(KTEXTTEMPLATE_TEMPLATE) << result.errorString();
+    d->setError(result.error(), result.errorString());
+
+    return stream;
+}
+
+RenderResult TemplateImpl::tryRender(Context *c) const
+{
+    QString output;
+    QTextStream textStream(&output);
+    OutputStream outputStream(&textStream);
+    auto result = tryRender(&outputStream, c);
+    result.d->m_output = output;
+    return result;
+}
+
+RenderResult TemplateImpl::tryRender(OutputStream *stream, Context *c) const
+{
+    Q_D(const Template);
+
+    if (d->m_compileError) {
+        RenderResult result;
+        result.d->m_error = d->m_compileError;
+        result.d->m_errorString = d->m_compileErrorString;
+        result.d->m_templateName = objectName();
+        return result;
+    }
+    return d->render(stream, c);
+}
+
+RenderResult TemplatePrivate::render(OutputStream *stream, Context *c) const
+{
+    Q_Q(const TemplateImpl);
+    RenderResult result;
+
+    const auto renderContext = c->renderContext();
+    // Included templates are rendered within the render of the outer one,
+    // which reports the location of the error.
+    if (renderContext->isEmpty())
+        renderContext->clearErrorLocation();
+
     c->clearExternalMedia();
 
-    c->renderContext()->push();
+    renderContext->push();
 
     try {
-        d->m_nodeList.render(stream, c);
-        d->setError(NoError, QString());
+        m_nodeList.render(stream, c);
     } catch (KTextTemplate::Exception &e) {
-        qCWarning(KTEXTTEMPLATE_TEMPLATE) << e.what();
-        d->setError(e.errorCode(), e.what());
+        result.d->m_error = e.errorCode();
+        result.d->m_errorString = e.what();
     }
 
-    c->renderContext()->pop();
+    renderContext->pop();
 
-    return stream;
+    result.d->m_templateName = q->objectName();
+    if (result.d->m_error && renderContext->hasErrorLocation()) {
+        result.d->m_templateName = renderContext->errorTemplateName();
+        // The Lexer counts lines from 0.
+        result.d->m_lineNumber = renderContext->errorLineNumber() + 1;
+    }
+    return result;
 }
 
 NodeList TemplateImpl::nodeList() const
@@ -103,10 +374,59 @@ void TemplateImpl::setNodeList(const NodeList &list)
 {
     Q_D(Template);
     d->m_nodeList = list;
+    ++d->m_generation;
+    d->clearIncrementalState();
+}
+
+quint64 TemplateImpl::generation() const
+{
+    Q_D(const Template);
+    return d->m_generation;
+}
+
+void TemplateImpl::applyEdit(int position, int length, const QString &text)
+{
+    Q_D(Template);
+    Q_ASSERT(position >= 0 && length >= 0 && position + length <= d->m_source.size());
+
+    auto content = d->m_source;
+    content.replace(position, length, text);
+
+    try {
+        if (!d->m_incremental || !d->recompile(position, length, text.size(), content))
+            d->compileIncrementally(content);
+        d->setCompileError(NoError, QString());
+    } catch (KTextTemplate::Exception &e) {
+        qCWarning(KTEXTTEMPLATE_TEMPLATE) << e.what();
+        d->clearNodes();
+        d->m_source = content;
+        d->setCompileError(e.errorCode(), e.what());
+    }
+}
+
+qsizetype TemplatePrivate::approximateSize() const
+{
+    Q_Q(const TemplateImpl);
+    // Nodes are children of the template. Each costs the QObject, its private
+    // data and the node's own members, roughly.
+    const auto nodeCount = q->findChildren<QObject *>().size();
+    auto size = qsizetype(sizeof(TemplateImpl) + sizeof(TemplatePrivate)) + nodeCount * 256;
+    // The source of templates loaded from a bundle is part of the mapped file.
+    if (!m_bundle)
+        size += m_source.size() * sizeof(QChar);
+    return size;
+}
+
+void TemplatePrivate::setCompileError(Error type, const QString &message)
+{
+    m_compileError = type;
+    m_compileErrorString = message;
+    setError(type, message);
 }
 
 void TemplatePrivate::setError(Error type, const QString &message) const
 {
+    const QMutexLocker locker(&m_errorMutex);
     m_error = type;
     m_errorString = message;
 }
@@ -114,12 +434,14 @@ void TemplatePrivate::setError(Error type, const QString &message) const
 Error TemplateImpl::error() const
 {
     Q_D(const Template);
+    const QMutexLocker locker(&d->m_errorMutex);
     return d->m_error;
 }
 
 QString TemplateImpl::errorString() const
 {
     Q_D(const Template);
+    const QMutexLocker locker(&d->m_errorMutex);
     return d->m_errorString;
 }
 
@@ -129,4 +451,40 @@ Engine const *TemplateImpl::engine() const
     return d->m_engine.data();
 }
 
+RenderResult::RenderResult()
+    : d(new RenderResultPrivate)
+{
+}
+
+RenderResult::RenderResult(const RenderResult &other) = default;
+
+RenderResult::~RenderResult() = default;
+
+RenderResult &RenderResult::operator=(const RenderResult &other) = default;
+
+QString RenderResult::output() const
+{
+    return d->m_output;
+}
+
+Error RenderResult::error() const
+{
+    return d->m_error;
+}
+
+QString RenderResult::errorString() const
+{
+    return d->m_errorString;
+}
+
+int RenderResult::lineNumber() const
+{
+    return d->m_lineNumber;
+}
+
+QString RenderResult::templateName() const
+{
+    return d->m_templateName;
+}
+
 #include "moc_template.cpp"
@@ -14,6 +14,7 @@
 #include "ktexttemplate_export.h"
 #include "node.h"
 
+#include <QSharedDataPointer>
 #include <QSharedPointer>
 #include <QStringList>
 
@@ -23,6 +24,7 @@ class Context;
 class Engine;
 class TemplateImpl;
 class OutputStream;
+class RenderResultPrivate;
 
 /*!
  * \typedef KTextTemplate::Template
@@ -30,6 +32,89 @@ class OutputStream;
  */
 typedef QSharedPointer<TemplateImpl> Template;
 
+/*!
+  \class KTextTemplate::RenderResult
+  \inheaderfile KTextTemplate/Template
+  \inmodule KTextTemplate
+
+  \brief The RenderResult class holds the outcome of rendering a Template.
+
+  A RenderResult is returned by TemplateImpl::tryRender. Unlike the error
+  reported by TemplateImpl::error, it belongs to a single render, so it is
+  reliable when a Template is rendered by several threads at once.
+
+  \code
+    const auto result = t->tryRender(&context);
+    if (result.error()) {
+      qWarning() << result.templateName() << result.lineNumber()
+                 << result.errorString();
+      return;
+    }
+    use(result.output());
+  \endcode
+*/
+class KTEXTTEMPLATE_EXPORT RenderResult
+{
+public:
+    /*!
+      Constructs a result without output or error.
+    */
+    RenderResult();
+
+    /*!
+      Copy constructor.
+    */
+    RenderResult(const RenderResult &other);
+
+    /*!
+      Destructor.
+    */
+    ~RenderResult();
+
+    /*!
+      Assignment operator.
+    */
+    RenderResult &operator=(const RenderResult &other);
+
+    /*!
+      Returns the rendered output. It is empty if the Template was rendered
+      to an OutputStream.
+
+      If an error occurred, it contains the output up to the error.
+    */
+    QString output() const;
+
+    /*!
+      Returns the error which stopped rendering, or NoError.
+    */
+    Error error() const;
+
+    /*!
+      Returns a description of the error.
+    */
+    QString errorString() const;
+
+    /*!
+      Returns the line, counting from 1, of the tag or variable which failed
+      to render, or -1 if it is not known, for example if the Template failed
+      to compile.
+    */
+    int lineNumber() const;
+
+    /*!
+      Returns the name of the Template in which the error occurred. This is
+      the name of an included or extended Template if the error occurred in
+      it, and the name of the rendered Template otherwise.
+    */
+    QString templateName() const;
+
+private:
+    QSharedDataPointer<RenderResultPrivate> d;
+
+    friend class TemplateImpl;
+    friend class TemplatePrivate;
+};
+
 class TemplatePrivate;
 
 /*!
@@ -79,6 +164,23 @@ class TemplatePrivate;
 
   If there is an error in parsing or rendering, the error and
   errorString methods can be used to check the source of the error.
+
+  \section1 Thread safety
+
+  A compiled Template may be rendered by several threads at the same time,
+  provided each render uses its own Context, OutputStream and localizer. The
+  state of a render, such as the last value seen by \c {{% ifchanged %}} or
+  the current block of \c {{% block %}}, is kept in the
+  \l {Context::renderContext()} {RenderContext} of the Context rather than in
+  the nodes of the Template. Filters are applied with a per-thread stream and
+  context. Templates loaded while rendering, for example by
+  \c {{% include %}}, are loaded through the Engine, which may be used from
+  several threads as long as it is not reconfigured meanwhile. Libraries of
+  scriptable tags are not thread-safe.
+
+  The render methods set error and errorString, which describe the most
+  recently finished render when a Template is rendered concurrently. Use
+  tryRender to get the error of a particular render.
 */
 class KTEXTTEMPLATE_EXPORT TemplateImpl : public QObject
 {
@@ -96,6 +198,27 @@ public:
     */
     OutputStream *render(OutputStream *stream, Context *c) const;
 
+    /*!
+      Renders the Template given the Context \a c, and returns the output
+      together with the error which occurred, if any.
+
+      Unlike render, this does not set the error and errorString of the
+      Template. The Template is not modified at all, so a shared Template can
+      be rendered concurrently without locking.
+
+      If the Template failed to compile, it is not rendered and the result
+      holds the compile error.
+    */
+    RenderResult tryRender(Context *c) const;
+
+    /*!
+      Renders the Template to the OutputStream \a stream given the Context
+      \a c, and returns the error which occurred, if any.
+
+      The output of the returned RenderResult is empty.
+    */
+    RenderResult tryRender(OutputStream *stream, Context *c) const;
+
     /*!
       \internal
     */
@@ -106,6 +229,36 @@ public:
     */
     void setNodeList(const NodeList &list);
 
+    /*!
+      \internal
+
+      Returns a number which changes each time the nodes of the Template
+      change, such as when its content is set or edited.
+    */
+    quint64 generation() const;
+
+    /*!
+      Replaces \a length characters at \a position in the source of the
+      Template with \a text, and recompiles it.
+
+      This is intended for editors which recompile a template as it is being
+      edited. Only the part of the source around the edit is tokenized again,
+      and only the top-level nodes containing changed tokens, such as an
+      enclosing \c {{% block %}} or \c {{% for %}} tag, are parsed again. All
+      other nodes are reused.
+
+      If the edit cannot be applied incrementally, for example because it
+      changes the libraries loaded with \c {{% load %}}, the whole source is
+      compiled again. The first edit of a Template also compiles the whole
+      source, recording the information needed for later edits.
+
+      If compiling fails, the error and errorString methods describe the
+      error and the Template renders nothing until a later edit fixes it.
+
+      The Template must not be rendered while it is being edited.
+    */
+    void applyEdit(int position, int length, const QString &text);
+
     /*!
       Returns an error code for the error encountered.
     */
@@ -135,8 +288,10 @@ private:
 private:
     Q_DECLARE_PRIVATE(Template)
     TemplatePrivate *const d_ptr;
+    friend class CachingLoaderDecoratorPrivate;
     friend class Engine;
     friend class Parser;
+    friend class TemplateBundle;
 };
 }
 
@@ -11,14 +11,28 @@
 #define KTEXTTEMPLATE_TEMPLATE_P_H
 
 #include "engine.h"
+#include "lexer_p.h"
+#include "parser_p.h"
 #include "template.h"
 
+#include <QMutex>
 #include <QPointer>
 
 namespace KTextTemplate
 {
 
 class Engine;
+class TemplateBundle;
+
+class RenderResultPrivate : public QSharedData
+{
+public:
+    QString m_output;
+    Error m_error = NoError;
+    QString m_errorString;
+    int m_lineNumber = -1;
+    QString m_templateName;
+};
 
 class TemplatePrivate
 {
@@ -31,20 +45,55 @@ class TemplatePrivate
     }
 
     void parse();
-    NodeList compileString(const QString &str);
+    void compileString(const QString &str);
+    void compileTokens(const QList<Token> &tokens);
     void setError(Error type, const QString &message) const;
+    void setCompileError(Error type, const QString &message);
+    RenderResult render(OutputStream *stream, Context *c) const;
+
+    void compileIncrementally(const QString &str);
+    bool recompile(int position, int removed, int added, const QString &str);
+    void clearNodes();
+    void clearIncrementalState();
+
+    // An estimate of the memory used by the compiled template.
+    qsizetype approximateSize() const;
 
     Q_DECLARE_PUBLIC(TemplateImpl)
     TemplateImpl *const q_ptr;
 
+    // Rendering sets the error, and may happen on several threads at once.
+    mutable QMutex m_errorMutex;
     mutable Error m_error;
     mutable QString m_errorString;
+    // Only set while compiling, and reported by TemplateImpl::tryRender().
+    Error m_compileError = NoError;
+    QString m_compileErrorString;
     NodeList m_nodeList;
+    // Changes each time m_nodeList does.
+    quint64 m_generation = 0;
+    // The TextNodes in m_nodeList reference the data of the source string.
+    QString m_source;
+    // Keeps the source of templates loaded from a precompiled bundle alive.
+    QSharedPointer<const TemplateBundle> m_bundle;
     bool m_smartTrim;
+
+    // The state recorded for incremental compilation. Each top-level node
+    // keeps the source it was parsed from alive.
+    struct CompiledNode {
+        ParsedNode parsed;
+        QString source;
+    };
+    bool m_incremental = false;
+    QList<LexerCheckpoint> m_checkpoints;
+    QList<CompiledNode> m_compiledNodes;
+    ParserState m_finalParserState;
+    int m_tokenCount = 0;
     QPointer<const Engine> m_engine;
 
     friend class KTextTemplate::Engine;
     friend class Parser;
+    friend class TemplateBundle;
 };
 }
 
@@ -0,0 +1,165 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include "templatearchive_p.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QSaveFile>
+
+#include <algorithm>
+
+using namespace KTextTemplate;
+
+bool TemplateArchive::open(const QString &fileName, QString *errorString)
+{
+    const auto fail = [&](const QString &message) {
+        if (errorString)
+            *errorString = QStringLiteral("%1: %2").arg(fileName, message);
+        m_data = nullptr;
+        m_header = nullptr;
+        m_file.close();
+        return false;
+    };
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return fail(m_file.errorString());
+
+    const auto size = quint64(m_file.size());
+    if (size < sizeof(Header))
+        return fail(QStringLiteral("Not a template archive"));
+
+    m_data = m_file.map(0, size);
+    if (!m_data)
+        return fail(m_file.errorString());
+
+    m_header = reinterpret_cast<const Header *>(m_data);
+    if (m_header->magic != Magic)
+        return fail(QStringLiteral("Not a template archive, or written on a machine with a different byte order"));
+    if (m_header->version != Version)
+        return fail(QStringLiteral("Unsupported template archive version %1").arg(m_header->version));
+
+    const auto dataStart = sizeof(Header) + quint64(m_header->fileCount) * sizeof(Entry) + m_header->nameLength;
+    if (dataStart > size)
+        return fail(QStringLiteral("Truncated or corrupt template archive"));
+
+    m_entries = reinterpret_cast<const Entry *>(m_data + sizeof(Header));
+    m_names = reinterpret_cast<const char *>(m_entries + m_header->fileCount);
+
+    // The lookups rely on the entries being valid and sorted.
+    for (quint32 i = 0; i < m_header->fileCount; ++i) {
+        const auto &entry = m_entries[i];
+        if (quint64(entry.nameOffset) + entry.nameLength > m_header->nameLength || entry.dataOffset < dataStart || entry.dataOffset > size
+            || entry.dataSize > size - entry.dataOffset)
+            return fail(QStringLiteral("Corrupt file in template archive"));
+        if (i > 0 && !(name(m_entries[i - 1]) < name(entry)))
+            return fail(QStringLiteral("Unsorted template archive"));
+    }
+    return true;
+}
+
+QString TemplateArchive::fileName() const
+{
+    return m_file.fileName();
+}
+
+QStringList TemplateArchive::fileNames() const
+{
+    QStringList names;
+    if (!m_header)
+        return names;
+    names.reserve(m_header->fileCount);
+    for (quint32 i = 0; i < m_header->fileCount; ++i)
+        names.append(QString::fromUtf8(name(m_entries[i])));
+    return names;
+}
+
+bool TemplateArchive::contains(const QString &name) const
+{
+    return find(name);
+}
+
+QByteArrayView TemplateArchive::data(const QString &name) const
+{
+    const auto entry = find(name);
+    if (!entry)
+        return {};
+    return QByteArrayView(m_data + entry->dataOffset, qsizetype(entry->dataSize));
+}
+
+QByteArrayView TemplateArchive::name(const Entry &entry) const
+{
+    return QByteArrayView(m_names + entry.nameOffset, entry.nameLength);
+}
+
+const TemplateArchive::Entry *TemplateArchive::find(const QString &name) const
+{
+    if (!m_header)
+        return nullptr;
+    const auto key = name.toUtf8();
+    const auto end = m_entries + m_header->fileCount;
+    const auto it = std::lower_bound(m_entries, end, key, [this](const Entry &entry, const QByteArray &key) {
+        return this->name(entry) < QByteArrayView(key);
+    });
+    if (it == end || this->name(*it) != QByteArrayView(key))
+        return nullptr;
+    return it;
+}
+
+bool TemplateArchive::write(const QString &fileName, const QString &directory, QString *errorString)
+{
+    const auto fail = [&](const QString &message) {
+        if (errorString)
+            *errorString = message;
+        return false;
+    };
+
+    const QDir dir(directory);
+    QList<std::pair<QByteArray, QString>> files;
+    QDirIterator it(directory, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const auto path = it.next();
+        files.append({dir.relativeFilePath(path).toUtf8(), path});
+    }
+    std::sort(files.begin(), files.end());
+
+    QList<Entry> entries;
+    QByteArray names;
+    for (const auto &file : std::as_const(files)) {
+        entries.append({quint32(names.size()), quint32(file.first.size()), 0, 0});
+        names += file.first;
+    }
+
+    QSaveFile output(fileName);
+    if (!output.open(QIODevice::WriteOnly))
+        return fail(QStringLiteral("%1: %2").arg(fileName, output.errorString()));
+
+    // The entries are written again once the offsets of the data are known.
+    const Header header{Magic, Version, quint32(entries.size()), quint32(names.size())};
+    output.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+    output.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(Entry));
+    output.write(names);
+
+    for (qsizetype i = 0; i < files.size(); ++i) {
+        QFile input(files.at(i).second);
+        if (!input.open(QIODevice::ReadOnly))
+            return fail(QStringLiteral("%1: %2").arg(input.fileName(), input.errorString()));
+        entries[i].dataOffset = quint64(output.pos());
+        const auto content = input.readAll();
+        entries[i].dataSize = quint64(content.size());
+        output.write(content);
+    }
+
+    output.seek(sizeof(Header));
+    output.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(Entry));
+    if (!output.commit())
+        return fail(QStringLiteral("%1: %2").arg(fileName, output.errorString()));
+    return true;
+}
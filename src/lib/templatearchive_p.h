@@ -0,0 +1,92 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#ifndef KTEXTTEMPLATE_TEMPLATEARCHIVE_P_H
+#define KTEXTTEMPLATE_TEMPLATEARCHIVE_P_H
+
+#include <QByteArrayView>
+#include <QFile>
+#include <QStringList>
+
+namespace KTextTemplate
+{
+
+/*
+  A memory-mapped archive of template and media files (a .kta file).
+
+  The layout of an archive is:
+
+    Header
+    Entry[fileCount]     one for each file, sorted by name
+    char[nameLength]     the UTF-8 names of all files
+    file data
+
+  Names are paths relative to the directory the archive was written from,
+  so the first component of the name of a themed file is the theme. Files
+  are looked up by a binary search over the mapped entries, so opening an
+  archive does not read the directory into memory.
+
+  All values are stored in the byte order of the machine which wrote the
+  archive, and archives with a different byte order or version are
+  rejected.
+*/
+class TemplateArchive
+{
+public:
+    enum { Magic = 0x4B544131, Version = 1 };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 fileCount;
+        quint32 nameLength;
+    };
+
+    struct Entry {
+        quint32 nameOffset;
+        quint32 nameLength;
+        quint64 dataOffset;
+        quint64 dataSize;
+    };
+
+    /*
+      Maps the archive \a fileName. Returns false and sets \a errorString if
+      it is not a valid archive.
+    */
+    bool open(const QString &fileName, QString *errorString);
+
+    QString fileName() const;
+    QStringList fileNames() const;
+    bool contains(const QString &name) const;
+
+    /*
+      Returns the content of the file \a name, which references the mapped
+      archive, or a null view if there is no such file.
+    */
+    QByteArrayView data(const QString &name) const;
+
+    /*
+      Writes the files in \a directory and its subdirectories as an archive
+      to \a fileName.
+    */
+    static bool write(const QString &fileName, const QString &directory, QString *errorString);
+
+private:
+    QByteArrayView name(const Entry &entry) const;
+    const Entry *find(const QString &name) const;
+
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    const Header *m_header = nullptr;
+    const Entry *m_entries = nullptr;
+    const char *m_names = nullptr;
+};
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include "templatebundle_p.h"
+
+#include "lexer_p.h"
+#include "template_p.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+
+using namespace KTextTemplate;
+
+bool TemplateBundle::open(const QString &fileName, QString *errorString)
+{
+    const auto fail = [&](const QString &message) {
+        if (errorString)
+            *errorString = QStringLiteral("%1: %2").arg(fileName, message);
+        m_header = nullptr;
+        m_entries.clear();
+        m_file.close();
+        return false;
+    };
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return fail(m_file.errorString());
+
+    const auto size = m_file.size();
+    if (size < qint64(sizeof(Header)))
+        return fail(QStringLiteral("Not a template bundle"));
+
+    const auto data = m_file.map(0, size);
+    if (!data)
+        return fail(m_file.errorString());
+
+    m_header = reinterpret_cast<const Header *>(data);
+    if (m_header->magic != Magic)
+        return fail(QStringLiteral("Not a template bundle, or written on a machine with a different byte order"));
+    if (m_header->version != Version)
+        return fail(QStringLiteral("Unsupported template bundle version %1").arg(m_header->version));
+
+    const auto expectedSize = qint64(sizeof(Header)) + qint64(m_header->templateCount) * qint64(sizeof(Entry))
+        + qint64(m_header->tokenCount) * qint64(sizeof(TokenRecord)) + qint64(m_header->stringLength) * qint64(sizeof(char16_t));
+    if (size != expectedSize)
+        return fail(QStringLiteral("Truncated or corrupt template bundle"));
+
+    const auto entries = reinterpret_cast<const Entry *>(data + sizeof(Header));
+    m_tokens = reinterpret_cast<const TokenRecord *>(entries + m_header->templateCount);
+    m_strings = reinterpret_cast<const char16_t *>(m_tokens + m_header->tokenCount);
+
+    const auto isString = [this](quint32 offset, quint32 length) {
+        return quint64(offset) + length <= m_header->stringLength;
+    };
+
+    for (quint32 i = 0; i < m_header->tokenCount; ++i) {
+        const auto &token = m_tokens[i];
+        if (token.type < TextToken || token.type > CommentToken || !isString(token.contentOffset, token.contentLength))
+            return fail(QStringLiteral("Corrupt token in template bundle"));
+    }
+
+    m_entries.reserve(m_header->templateCount);
+    for (quint32 i = 0; i < m_header->templateCount; ++i) {
+        const auto &entry = entries[i];
+        if (!isString(entry.nameOffset, entry.nameLength) || !isString(entry.sourceOffset, entry.sourceLength)
+            || quint64(entry.firstToken) + entry.tokenCount > m_header->tokenCount)
+            return fail(QStringLiteral("Corrupt template in template bundle"));
+        m_entries.insert(QString(reinterpret_cast<const QChar *>(m_strings + entry.nameOffset), entry.nameLength), entry);
+    }
+    return true;
+}
+
+QString TemplateBundle::fileName() const
+{
+    return m_file.fileName();
+}
+
+bool TemplateBundle::smartTrim() const
+{
+    return m_header && (m_header->flags & SmartTrim);
+}
+
+QStringList TemplateBundle::templateNames() const
+{
+    return m_entries.keys();
+}
+
+bool TemplateBundle::contains(const QString &name) const
+{
+    return m_entries.contains(name);
+}
+
+QString TemplateBundle::string(quint32 offset, quint32 length) const
+{
+    return QString::fromRawData(reinterpret_cast<const QChar *>(m_strings + offset), length);
+}
+
+Template TemplateBundle::loadTemplate(const QString &name, Engine const *engine) const
+{
+    const auto it = m_entries.constFind(name);
+    if (it == m_entries.constEnd())
+        return {};
+
+    const auto &entry = it.value();
+    QList<Token> tokens;
+    tokens.reserve(entry.tokenCount);
+    for (auto i = entry.firstToken; i < entry.firstToken + entry.tokenCount; ++i) {
+        const auto &record = m_tokens[i];
+        Token token;
+        token.tokenType = record.type;
+        token.linenumber = record.lineNumber;
+        // Like the Lexer, only text tokens reference the template source.
+        token.content = string(record.contentOffset, record.contentLength);
+        if (record.type != TextToken)
+            token.content = QString(token.content.constData(), token.content.size());
+        tokens.append(token);
+    }
+
+    auto t = Template(new TemplateImpl(engine, smartTrim()));
+    t->setObjectName(name);
+    auto d = t->d_func();
+    d->m_bundle = sharedFromThis();
+    d->m_source = string(entry.sourceOffset, entry.sourceLength);
+    d->compileTokens(tokens);
+    return t;
+}
+
+bool TemplateBundle::write(const QString &fileName, const QHash<QString, QString> &templates, bool smartTrim, QString *errorString)
+{
+    auto names = templates.keys();
+    std::sort(names.begin(), names.end());
+
+    QList<Entry> entries;
+    QList<TokenRecord> tokens;
+    QString strings;
+
+    for (const auto &name : std::as_const(names)) {
+        const auto source = templates.value(name);
+
+        Entry entry;
+        entry.nameOffset = strings.size();
+        entry.nameLength = name.size();
+        strings += name;
+        entry.sourceOffset = strings.size();
+        entry.sourceLength = source.size();
+        strings += source;
+        entry.firstToken = tokens.size();
+
+        Lexer l(source);
+        const auto templateTokens = l.tokenize(smartTrim ? Lexer::SmartTrim : Lexer::NoSmartTrim);
+        const auto offsets = l.tokenOffsets();
+        Q_ASSERT(offsets.size() == templateTokens.size());
+        for (qsizetype i = 0; i < templateTokens.size(); ++i) {
+            const auto &token = templateTokens.at(i);
+            tokens.append({token.tokenType, token.linenumber, quint32(entry.sourceOffset + offsets.at(i)), quint32(token.content.size())});
+        }
+        entry.tokenCount = tokens.size() - entry.firstToken;
+        entries.append(entry);
+    }
+
+    const Header header{Magic, Version, smartTrim ? quint32(SmartTrim) : 0, quint32(entries.size()), quint32(tokens.size()), quint32(strings.size())};
+
+    QSaveFile file(fileName);
+    const auto writeData = [&file](const void *data, qint64 size) {
+        return file.write(static_cast<const char *>(data), size) == size;
+    };
+    // An unfinished file is discarded when it is not committed.
+    if (file.open(QIODevice::WriteOnly) && writeData(&header, sizeof(Header)) && writeData(entries.constData(), entries.size() * sizeof(Entry))
+        && writeData(tokens.constData(), tokens.size() * sizeof(TokenRecord)) && writeData(strings.constData(), strings.size() * sizeof(char16_t))
+        && file.commit())
+        return true;
+    if (errorString)
+        *errorString = QStringLiteral("%1: %2").arg(fileName, file.errorString());
+    return false;
+}
@@ -0,0 +1,104 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#ifndef KTEXTTEMPLATE_TEMPLATEBUNDLE_P_H
+#define KTEXTTEMPLATE_TEMPLATEBUNDLE_P_H
+
+#include "template.h"
+#include "token.h"
+
+#include <QEnableSharedFromThis>
+#include <QFile>
+#include <QHash>
+
+namespace KTextTemplate
+{
+
+/*
+  A memory-mapped bundle of precompiled templates (a .ktc file).
+
+  A bundle stores the source of each template together with the tokens the
+  Lexer produced for it, so that templates can be parsed from it without
+  tokenizing them again. The layout of a bundle is:
+
+    Header
+    Entry[templateCount]      one for each template, sorted by name
+    TokenRecord[tokenCount]   the tokens of all templates
+    char16_t[stringLength]    the names and sources of all templates
+
+  The offsets of the entries and tokens refer to the string table. All
+  values are stored in the byte order of the machine which wrote the
+  bundle, and bundles with a different byte order or version are rejected.
+
+  The text tokens and the source of the loaded templates reference the
+  mapped data, so each Template keeps the bundle alive.
+*/
+class TemplateBundle : public QEnableSharedFromThis<TemplateBundle>
+{
+public:
+    enum { Magic = 0x4B544331, Version = 1 };
+
+    enum Flag { SmartTrim = 0x1 };
+
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        quint32 flags;
+        quint32 templateCount;
+        quint32 tokenCount;
+        quint32 stringLength;
+    };
+
+    struct Entry {
+        quint32 nameOffset;
+        quint32 nameLength;
+        quint32 sourceOffset;
+        quint32 sourceLength;
+        quint32 firstToken;
+        quint32 tokenCount;
+    };
+
+    struct TokenRecord {
+        qint32 type;
+        qint32 lineNumber;
+        quint32 contentOffset;
+        quint32 contentLength;
+    };
+
+    /*
+      Maps the bundle \a fileName. Returns false and sets \a errorString if
+      it is not a valid bundle.
+    */
+    bool open(const QString &fileName, QString *errorString);
+
+    QString fileName() const;
+    bool smartTrim() const;
+    QStringList templateNames() const;
+    bool contains(const QString &name) const;
+
+    Template loadTemplate(const QString &name, Engine const *engine) const;
+
+    /*
+      Tokenizes \a templates, a map of names to template sources, and writes
+      them as a bundle to \a fileName.
+    */
+    static bool write(const QString &fileName, const QHash<QString, QString> &templates, bool smartTrim, QString *errorString);
+
+private:
+    QString string(quint32 offset, quint32 length) const;
+
+    QFile m_file;
+    const Header *m_header = nullptr;
+    const TokenRecord *m_tokens = nullptr;
+    const char16_t *m_strings = nullptr;
+    QHash<QString, Entry> m_entries;
+};
+}
+
+#endif
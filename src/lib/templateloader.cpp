@@ -12,15 +12,28 @@
 #include "engine.h"
 #include "exception.h"
 #include "nulllocalizer_p.h"
+#include "templatearchive_p.h"
+#include "templatebundle_p.h"
 
 #include <QDir>
+#include <QDirIterator>
 #include <QFile>
 #include <QFileInfo>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSet>
+#include <QStringDecoder>
+#include <QTemporaryDir>
+
+#include <algorithm>
+#include <memory>
 
 using namespace KTextTemplate;
 
 AbstractTemplateLoader::~AbstractTemplateLoader() = default;
 
+AsyncTemplateLoaderInterface::~AsyncTemplateLoaderInterface() = default;
+
 namespace KTextTemplate
 {
 class FileSystemTemplateLoaderPrivate
@@ -33,9 +46,59 @@ class FileSystemTemplateLoaderPrivate
     Q_DECLARE_PUBLIC(FileSystemTemplateLoader)
     FileSystemTemplateLoader *const q_ptr;
 
+    QString templateFileName(const QString &name) const;
+    void buildIndex();
+
     QString m_themeName;
     QStringList m_templateDirs;
     const QSharedPointer<AbstractLocalizer> m_localizer;
+
+    // The files found for a name in the index, in the order of the template
+    // dirs. Names which are not in the index have no file.
+    struct IndexEntry {
+        // The first file found, and whether it is inside its template dir.
+        QString fileName;
+        bool isSafe = false;
+        // The first file found inside its template dir, for media.
+        QString safeFileName;
+    };
+    bool m_indexingEnabled = false;
+    QHash<QString, IndexEntry> m_index;
+};
+
+class PrecompiledTemplateLoaderPrivate
+{
+    PrecompiledTemplateLoaderPrivate(PrecompiledTemplateLoader *loader)
+        : q_ptr(loader)
+    {
+    }
+    Q_DECLARE_PUBLIC(PrecompiledTemplateLoader)
+    PrecompiledTemplateLoader *const q_ptr;
+
+    QSharedPointer<TemplateBundle> bundleFor(const QString &name) const;
+
+    QList<QSharedPointer<TemplateBundle>> m_bundles;
+};
+
+class ArchiveTemplateLoaderPrivate
+{
+    ArchiveTemplateLoaderPrivate(ArchiveTemplateLoader *loader)
+        : q_ptr(loader)
+    {
+    }
+    Q_DECLARE_PUBLIC(ArchiveTemplateLoader)
+    ArchiveTemplateLoader *const q_ptr;
+
+    QString archiveName(const QString &name) const;
+
+    std::unique_ptr<TemplateArchive> m_archive;
+    QString m_themeName;
+
+    // Media is extracted when it is first asked for, by any thread.
+    mutable QMutex m_mediaMutex;
+    QString m_mediaDirectory;
+    mutable std::unique_ptr<QTemporaryDir> m_temporaryMediaDirectory;
+    mutable QSet<QString> m_extractedMedia;
 };
 }
 
@@ -67,6 +130,7 @@ void FileSystemTemplateLoader::setTheme(const QString &themeName)
     d->m_themeName = themeName;
     for (const QString &dir : templateDirs())
         d->m_localizer->loadCatalog(dir + QLatin1Char('/') + themeName, themeName);
+    d->buildIndex();
 }
 
 QString FileSystemTemplateLoader::themeName() const
@@ -84,6 +148,7 @@ void FileSystemTemplateLoader::setTemplateDirs(const QStringList &dirs)
     d->m_templateDirs = dirs;
     for (const QString &dir : templateDirs())
         d->m_localizer->loadCatalog(dir + QLatin1Char('/') + d->m_themeName, d->m_themeName);
+    d->buildIndex();
 }
 
 QStringList FileSystemTemplateLoader::templateDirs() const
@@ -92,9 +157,69 @@ QStringList FileSystemTemplateLoader::templateDirs() const
     return d->m_templateDirs;
 }
 
+void FileSystemTemplateLoader::setIndexingEnabled(bool enabled)
+{
+    Q_D(FileSystemTemplateLoader);
+    d->m_indexingEnabled = enabled;
+    d->buildIndex();
+}
+
+bool FileSystemTemplateLoader::isIndexingEnabled() const
+{
+    Q_D(const FileSystemTemplateLoader);
+    return d->m_indexingEnabled;
+}
+
+void FileSystemTemplateLoader::refreshIndex()
+{
+    Q_D(FileSystemTemplateLoader);
+    d->buildIndex();
+}
+
+QStringList FileSystemTemplateLoader::defaultTemplateNameFilters()
+{
+    return {
+        QStringLiteral("*.html"),
+        QStringLiteral("*.htm"),
+        QStringLiteral("*.xhtml"),
+        QStringLiteral("*.xml"),
+        QStringLiteral("*.txt"),
+        QStringLiteral("*.tmpl"),
+        QStringLiteral("*.tpl"),
+    };
+}
+
+QStringList FileSystemTemplateLoader::templateNames(const QStringList &nameFilters) const
+{
+    Q_D(const FileSystemTemplateLoader);
+    if (d->m_indexingEnabled) {
+        QStringList names;
+        for (auto it = d->m_index.constBegin(); it != d->m_index.constEnd(); ++it) {
+            if (QDir::match(nameFilters, it.key().section(QLatin1Char('/'), -1)))
+                names.append(it.key());
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    QStringList names;
+    for (const auto &templateDir : d->m_templateDirs) {
+        const QDir dir(templateDir + QLatin1Char('/') + d->m_themeName);
+        QDirIterator it(dir.path(), nameFilters, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            names.append(dir.relativeFilePath(it.next()));
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    return names;
+}
+
 bool FileSystemTemplateLoader::canLoadTemplate(const QString &name) const
 {
     Q_D(const FileSystemTemplateLoader);
+    if (d->m_indexingEnabled)
+        return d->m_index.contains(QDir::cleanPath(name));
+
     auto i = 0;
     QFile file;
 
@@ -113,38 +238,172 @@ bool FileSystemTemplateLoader::canLoadTemplate(const QString &name) const
     return true;
 }
 
-Template FileSystemTemplateLoader::loadByName(const QString &fileName, Engine const *engine) const
+// Whether the canonical path of a file is inside a canonical directory, rather
+// than in a sibling directory whose name starts with the same characters.
+static bool isInDirectory(const QString &canonicalFilePath, const QString &canonicalDir)
 {
-    Q_D(const FileSystemTemplateLoader);
+    if (canonicalDir.isEmpty())
+        return false;
+    return canonicalFilePath.startsWith(canonicalDir.endsWith(QLatin1Char('/')) ? canonicalDir : canonicalDir + QLatin1Char('/'));
+}
+
+// Appends the files below \a path to \a files, following symbolic links to
+// directories except those leading back to one of their own ancestors.
+static void listFiles(const QString &path, QStringList &ancestors, QFileInfoList &files)
+{
+    const auto canonicalPath = QFileInfo(path).canonicalFilePath();
+    if (ancestors.contains(canonicalPath))
+        return;
+    ancestors.append(canonicalPath);
+    const auto entries = QDir(path).entryInfoList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot);
+    for (const auto &fileInfo : entries) {
+        if (fileInfo.isDir())
+            listFiles(fileInfo.filePath(), ancestors, files);
+        else if (fileInfo.isFile())
+            files.append(fileInfo);
+    }
+    ancestors.removeLast();
+}
+
+void FileSystemTemplateLoaderPrivate::buildIndex()
+{
+    m_index.clear();
+    if (!m_indexingEnabled)
+        return;
+
+    for (const auto &templateDir : std::as_const(m_templateDirs)) {
+        const auto canonicalTemplateDir = QDir(templateDir).canonicalPath();
+        const QDir dir(templateDir + QLatin1Char('/') + m_themeName);
+        QStringList ancestors;
+        QFileInfoList files;
+        listFiles(dir.path(), ancestors, files);
+        for (const auto &fileInfo : std::as_const(files)) {
+            const auto fileName = fileInfo.filePath();
+            const auto isSafe = isInDirectory(fileInfo.canonicalFilePath(), canonicalTemplateDir);
+            auto &entry = m_index[dir.relativeFilePath(fileName)];
+            if (entry.fileName.isEmpty()) {
+                entry.fileName = fileName;
+                entry.isSafe = isSafe;
+            }
+            if (entry.safeFileName.isEmpty() && isSafe)
+                entry.safeFileName = fileName;
+        }
+    }
+}
+
+// Like reading in QIODevice::Text mode, turns each "\r\n" into "\n" and keeps
+// lone carriage returns. The freshly decoded string is compacted in place.
+static void removeCarriageReturns(QString &content)
+{
+    const auto first = content.indexOf(u"\r\n");
+    if (first < 0)
+        return;
+    const auto data = content.data();
+    const auto size = content.size();
+    auto length = first;
+    for (auto i = first; i < size; ++i) {
+        if (data[i] != u'\r' || i + 1 == size || data[i + 1] != u'\n')
+            data[length++] = data[i];
+    }
+    content.truncate(length);
+}
+
+static QString decodeTemplate(QByteArrayView data)
+{
+    QStringDecoder decoder(QStringConverter::Utf8);
+    QString content = decoder(data);
+    removeCarriageReturns(content);
+    return content;
+}
+
+// Decodes the file straight from a mapping of it. The resulting string is the
+// only copy of the content, and becomes the source of the template. Files
+// which cannot be mapped are decoded as they are read, without holding all of
+// their bytes.
+static QString readTemplateFile(QFile &file)
+{
+    const auto size = file.size();
+    if (const auto data = size > 0 ? file.map(0, size) : nullptr) {
+        const auto content = decodeTemplate(QByteArrayView(data, size));
+        file.unmap(data);
+        return content;
+    }
+
+    QStringDecoder decoder(QStringConverter::Utf8);
+    QString content;
+    content.reserve(decoder.requiredSpace(size));
+    qsizetype length = 0;
+    char buffer[16384];
+    qint64 read;
+    while ((read = file.read(buffer, sizeof(buffer))) > 0) {
+        content.resize(length + decoder.requiredSpace(read));
+        length = decoder.appendToBuffer(content.data() + length, QByteArrayView(buffer, read)) - content.constData();
+    }
+    content.truncate(length);
+    removeCarriageReturns(content);
+    return content;
+}
+
+QString FileSystemTemplateLoaderPrivate::templateFileName(const QString &name) const
+{
+    if (m_indexingEnabled) {
+        const auto entry = m_index.value(QDir::cleanPath(name));
+        return entry.isSafe ? entry.fileName : QString();
+    }
+
     auto i = 0;
     QFile file;
 
     while (!file.exists()) {
-        if (i >= d->m_templateDirs.size())
+        if (i >= m_templateDirs.size())
             break;
 
-        file.setFileName(d->m_templateDirs.at(i) + QLatin1Char('/') + d->m_themeName + QLatin1Char('/') + fileName);
+        file.setFileName(m_templateDirs.at(i) + QLatin1Char('/') + m_themeName + QLatin1Char('/') + name);
         const QFileInfo fi(file);
 
-        if (file.exists() && !fi.canonicalFilePath().contains(QDir(d->m_templateDirs.at(i)).canonicalPath()))
+        if (file.exists() && !isInDirectory(fi.canonicalFilePath(), QDir(m_templateDirs.at(i)).canonicalPath()))
             return {};
         ++i;
     }
 
-    if (!file.exists() || !file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.exists())
+        return {};
+    return file.fileName();
+}
+
+QString FileSystemTemplateLoader::templateFileName(const QString &name) const
+{
+    Q_D(const FileSystemTemplateLoader);
+    return d->templateFileName(name);
+}
+
+Template FileSystemTemplateLoader::loadByName(const QString &fileName, Engine const *engine) const
+{
+    Q_D(const FileSystemTemplateLoader);
+    const auto path = d->templateFileName(fileName);
+    if (path.isEmpty())
         return {};
-    }
 
-    QTextStream fstream(&file);
-    fstream.setEncoding(QStringConverter::Utf8);
-    const auto fileContent = fstream.readAll();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
 
-    return engine->newTemplate(fileContent, fileName);
+    return engine->newTemplate(readTemplateFile(file), fileName);
 }
 
 std::pair<QString, QString> FileSystemTemplateLoader::getMediaUri(const QString &fileName) const
 {
     Q_D(const FileSystemTemplateLoader);
+    if (d->m_indexingEnabled) {
+        const auto safeFileName = d->m_index.value(QDir::cleanPath(fileName)).safeFileName;
+        if (safeFileName.isEmpty())
+            return {};
+        auto path = QFileInfo(safeFileName).absoluteFilePath();
+        path.chop(fileName.size());
+        return std::make_pair(path, fileName);
+    }
+
     auto i = 0;
     QFile file;
     while (!file.exists()) {
@@ -154,7 +413,7 @@ std::pair<QString, QString> FileSystemTemplateLoader::getMediaUri(const QString
         file.setFileName(d->m_templateDirs.at(i) + QLatin1Char('/') + d->m_themeName + QLatin1Char('/') + fileName);
 
         const QFileInfo fi(file);
-        if (!fi.canonicalFilePath().contains(QDir(d->m_templateDirs.at(i)).canonicalPath())) {
+        if (!isInDirectory(fi.canonicalFilePath(), QDir(d->m_templateDirs.at(i)).canonicalPath())) {
             ++i;
             continue;
         }
@@ -194,3 +453,224 @@ std::pair<QString, QString> InMemoryTemplateLoader::getMediaUri(const QString &f
     // This loader doesn't make any media available yet.
     return {};
 }
+
+PrecompiledTemplateLoader::PrecompiledTemplateLoader()
+    : AbstractTemplateLoader()
+    , d_ptr(new PrecompiledTemplateLoaderPrivate(this))
+{
+}
+
+PrecompiledTemplateLoader::~PrecompiledTemplateLoader()
+{
+    delete d_ptr;
+}
+
+QSharedPointer<TemplateBundle> PrecompiledTemplateLoaderPrivate::bundleFor(const QString &name) const
+{
+    for (const auto &bundle : m_bundles) {
+        if (bundle->contains(name))
+            return bundle;
+    }
+    return {};
+}
+
+bool PrecompiledTemplateLoader::addBundle(const QString &fileName, QString *errorString)
+{
+    Q_D(PrecompiledTemplateLoader);
+    auto bundle = QSharedPointer<TemplateBundle>::create();
+    if (!bundle->open(fileName, errorString))
+        return false;
+    d->m_bundles.append(bundle);
+    return true;
+}
+
+QStringList PrecompiledTemplateLoader::bundles() const
+{
+    Q_D(const PrecompiledTemplateLoader);
+    QStringList fileNames;
+    for (const auto &bundle : d->m_bundles)
+        fileNames.append(bundle->fileName());
+    return fileNames;
+}
+
+QStringList PrecompiledTemplateLoader::templateNames() const
+{
+    Q_D(const PrecompiledTemplateLoader);
+    QStringList names;
+    for (const auto &bundle : d->m_bundles)
+        names += bundle->templateNames();
+    names.removeDuplicates();
+    return names;
+}
+
+bool PrecompiledTemplateLoader::canLoadTemplate(const QString &name) const
+{
+    Q_D(const PrecompiledTemplateLoader);
+    return !d->bundleFor(name).isNull();
+}
+
+Template PrecompiledTemplateLoader::loadByName(const QString &name, Engine const *engine) const
+{
+    Q_D(const PrecompiledTemplateLoader);
+    const auto bundle = d->bundleFor(name);
+    if (!bundle || bundle->smartTrim() != engine->smartTrimEnabled())
+        return {};
+    return bundle->loadTemplate(name, engine);
+}
+
+std::pair<QString, QString> PrecompiledTemplateLoader::getMediaUri(const QString &fileName) const
+{
+    Q_UNUSED(fileName)
+    // Bundles contain no media.
+    return {};
+}
+
+bool PrecompiledTemplateLoader::writeBundle(const QString &fileName, const QHash<QString, QString> &templates, bool smartTrim, QString *errorString)
+{
+    return TemplateBundle::write(fileName, templates, smartTrim, errorString);
+}
+
+ArchiveTemplateLoader::ArchiveTemplateLoader()
+    : AbstractTemplateLoader()
+    , d_ptr(new ArchiveTemplateLoaderPrivate(this))
+{
+}
+
+ArchiveTemplateLoader::~ArchiveTemplateLoader()
+{
+    delete d_ptr;
+}
+
+bool ArchiveTemplateLoader::setArchive(const QString &fileName, QString *errorString)
+{
+    Q_D(ArchiveTemplateLoader);
+    auto archive = std::make_unique<TemplateArchive>();
+    if (!archive->open(fileName, errorString))
+        return false;
+    d->m_archive = std::move(archive);
+    const QMutexLocker locker(&d->m_mediaMutex);
+    d->m_extractedMedia.clear();
+    return true;
+}
+
+QString ArchiveTemplateLoader::archive() const
+{
+    Q_D(const ArchiveTemplateLoader);
+    return d->m_archive ? d->m_archive->fileName() : QString();
+}
+
+void ArchiveTemplateLoader::setTheme(const QString &themeName)
+{
+    Q_D(ArchiveTemplateLoader);
+    d->m_themeName = themeName;
+}
+
+QString ArchiveTemplateLoader::themeName() const
+{
+    Q_D(const ArchiveTemplateLoader);
+    return d->m_themeName;
+}
+
+void ArchiveTemplateLoader::setMediaDirectory(const QString &directory)
+{
+    Q_D(ArchiveTemplateLoader);
+    const QMutexLocker locker(&d->m_mediaMutex);
+    d->m_mediaDirectory = directory;
+    d->m_extractedMedia.clear();
+}
+
+QString ArchiveTemplateLoader::mediaDirectory() const
+{
+    Q_D(const ArchiveTemplateLoader);
+    const QMutexLocker locker(&d->m_mediaMutex);
+    return d->m_mediaDirectory;
+}
+
+QStringList ArchiveTemplateLoader::templateNames() const
+{
+    Q_D(const ArchiveTemplateLoader);
+    if (!d->m_archive)
+        return {};
+    auto names = d->m_archive->fileNames();
+    if (d->m_themeName.isEmpty())
+        return names;
+
+    const auto prefix = d->m_themeName + QLatin1Char('/');
+    QStringList themeNames;
+    for (const auto &name : std::as_const(names)) {
+        if (name.startsWith(prefix))
+            themeNames.append(name.mid(prefix.size()));
+    }
+    return themeNames;
+}
+
+QString ArchiveTemplateLoaderPrivate::archiveName(const QString &name) const
+{
+    return QDir::cleanPath(m_themeName.isEmpty() ? name : m_themeName + QLatin1Char('/') + name);
+}
+
+bool ArchiveTemplateLoader::canLoadTemplate(const QString &name) const
+{
+    Q_D(const ArchiveTemplateLoader);
+    return d->m_archive && d->m_archive->contains(d->archiveName(name));
+}
+
+Template ArchiveTemplateLoader::loadByName(const QString &name, Engine const *engine) const
+{
+    Q_D(const ArchiveTemplateLoader);
+    if (!d->m_archive)
+        return {};
+    const auto data = d->m_archive->data(d->archiveName(name));
+    if (data.isNull())
+        return {};
+    return engine->newTemplate(decodeTemplate(data), name);
+}
+
+std::pair<QString, QString> ArchiveTemplateLoader::getMediaUri(const QString &fileName) const
+{
+    Q_D(const ArchiveTemplateLoader);
+    if (!d->m_archive)
+        return {};
+    // Names in a valid archive never leave the directory, but the archive
+    // may have been crafted. The name may not leave the theme either, as the
+    // media path is returned relative to it.
+    const auto isOutside = [](const QString &path) {
+        return path == QLatin1String("..") || path.startsWith(QLatin1String("../")) || QDir::isAbsolutePath(path);
+    };
+    const auto cleanName = QDir::cleanPath(fileName);
+    const auto archiveName = d->archiveName(fileName);
+    if (isOutside(cleanName) || isOutside(archiveName))
+        return {};
+    const auto data = d->m_archive->data(archiveName);
+    if (data.isNull())
+        return {};
+
+    const QMutexLocker locker(&d->m_mediaMutex);
+    auto directory = d->m_mediaDirectory;
+    if (directory.isEmpty()) {
+        if (!d->m_temporaryMediaDirectory)
+            d->m_temporaryMediaDirectory = std::make_unique<QTemporaryDir>();
+        directory = d->m_temporaryMediaDirectory->path();
+    }
+    const auto path = directory + QLatin1Char('/') + archiveName;
+
+    if (!d->m_extractedMedia.contains(archiveName)) {
+        QDir().mkpath(QFileInfo(path).path());
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return {};
+        file.write(data.constData(), data.size());
+        if (!file.commit())
+            return {};
+        d->m_extractedMedia.insert(archiveName);
+    }
+
+    auto mediaPath = QFileInfo(path).absoluteFilePath();
+    mediaPath.chop(cleanName.size());
+    return std::make_pair(mediaPath, cleanName);
+}
+
+bool ArchiveTemplateLoader::writeArchive(const QString &fileName, const QString &directory, QString *errorString)
+{
+    return TemplateArchive::write(fileName, directory, errorString);
+}
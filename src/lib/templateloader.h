@@ -13,8 +13,11 @@
 #include "ktexttemplate_export.h"
 #include "template.h"
 
+#include <QFuture>
 #include <QSharedPointer>
 
+class QThreadPool;
+
 namespace KTextTemplate
 {
 
@@ -56,6 +59,44 @@ public:
     virtual bool canLoadTemplate(const QString &name) const = 0;
 };
 
+/*!
+  \class KTextTemplate::AsyncTemplateLoaderInterface
+  \inheaderfile KTextTemplate/TemplateLoader
+  \inmodule KTextTemplate
+
+  \brief An interface for loaders which load Templates asynchronously.
+
+  Engine::loadByNameAsync calls AbstractTemplateLoader::canLoadTemplate and
+  AbstractTemplateLoader::loadByName in a thread pool. Loaders which have a
+  better way to load a Template asynchronously, or which can report some
+  Templates at once, may inherit this interface in addition to
+  AbstractTemplateLoader.
+
+  \code
+    class NetworkTemplateLoader : public AbstractTemplateLoader, public AsyncTemplateLoaderInterface
+    {
+      // ...
+    };
+  \endcode
+
+  \sa Engine::loadByNameAsync
+*/
+class KTEXTTEMPLATE_EXPORT AsyncTemplateLoaderInterface
+{
+public:
+    virtual ~AsyncTemplateLoaderInterface();
+
+    /*!
+      Starts loading the Template called \a name, and returns a QFuture which
+      reports it when it is loaded. The future reports an invalid Template if
+      no content by that name exists.
+
+      \a pool is the thread pool passed to Engine::loadByNameAsync, which the
+      loader may use.
+    */
+    virtual QFuture<Template> loadByNameAsync(const QString &name, Engine const *engine, QThreadPool *pool) const = 0;
+};
+
 class FileSystemTemplateLoaderPrivate;
 
 /*!
@@ -116,6 +157,11 @@ class FileSystemTemplateLoaderPrivate;
 
   The template files loaded by a FileSystemTemplateLoader must be UTF-8
   encoded.
+
+  By default each lookup checks the directories for the file. With
+  setIndexingEnabled, the loader instead lists the files in the directories
+  once, and looks templates and media up in that index. Files added or
+  removed later are found after calling refreshIndex.
 */
 class KTEXTTEMPLATE_EXPORT FileSystemTemplateLoader : public AbstractTemplateLoader
 {
@@ -162,6 +208,53 @@ public:
      */
     QStringList templateDirs() const;
 
+    /*!
+      Returns the names of the files in the theme directory of the
+      templateDirs which match any of the wildcard \a nameFilters, sorted.
+      The names are paths relative to the theme directory, and the filters
+      are matched against the file names.
+
+      Media, such as style sheets and images, is not listed with the default
+      filters.
+
+      \sa defaultTemplateNameFilters, Engine::precompile
+    */
+    QStringList templateNames(const QStringList &nameFilters = defaultTemplateNameFilters()) const;
+
+    /*!
+      Returns the wildcard filters which match the file names of templates
+      by default, which are "*.html", "*.htm", "*.xhtml", "*.xml", "*.txt",
+      "*.tmpl" and "*.tpl".
+    */
+    static QStringList defaultTemplateNameFilters();
+
+    /*!
+      Sets whether templates and media are looked up in an index of the files
+      in the templateDirs to \a enabled. The index is built immediately, and
+      again when the templateDirs or the theme change.
+
+      This is false by default.
+
+      \sa refreshIndex
+    */
+    void setIndexingEnabled(bool enabled);
+
+    /*!
+      Returns whether templates and media are looked up in an index.
+    */
+    bool isIndexingEnabled() const;
+
+    /*!
+      Lists the files in the templateDirs again, if indexing is enabled.
+    */
+    void refreshIndex();
+
+    /*!
+      Returns the path of the file the template \a name is loaded from, or an
+      empty string if there is no such template.
+    */
+    QString templateFileName(const QString &name) const;
+
 private:
     Q_DECLARE_PRIVATE(FileSystemTemplateLoader)
     FileSystemTemplateLoaderPrivate *const d_ptr;
@@ -215,6 +308,215 @@ public:
 private:
     QHash<QString, QString> m_namedTemplates;
 };
+
+class PrecompiledTemplateLoaderPrivate;
+
+/*!
+  \class KTextTemplate::PrecompiledTemplateLoader
+  \inheaderfile KTextTemplate/TemplateLoader
+  \inmodule KTextTemplate
+
+  \brief The PrecompiledTemplateLoader loads Templates from precompiled
+  bundles.
+
+  A bundle is a \c .ktc file written by writeBundle, usually at build time.
+  It contains the templates already split into tokens, and is memory-mapped
+  when it is added to the loader, so that loading a Template from it does
+  not read or tokenize the template source.
+
+  \code
+    PrecompiledTemplateLoader::writeBundle("theme.ktc", {
+        {"mytemplate.html", "Hello {{ name }}"}
+    });
+
+    auto loader = QSharedPointer<PrecompiledTemplateLoader>::create();
+    loader->addBundle("theme.ktc");
+    engine->addTemplateLoader(loader);
+
+    engine->loadByName("mytemplate.html");
+  \endcode
+
+  The tokens of a template depend on whether smart trimming is enabled, so a
+  bundle only provides templates to Engines with the same
+  \l {Engine::smartTrimEnabled()} {smartTrimEnabled} setting as the one
+  it was written with. Other engines fall back to their next loader.
+
+  Bundles are specific to the byte order of the machine which wrote them,
+  and are versioned. Bundles which can not be read are rejected by addBundle.
+*/
+class KTEXTTEMPLATE_EXPORT PrecompiledTemplateLoader : public AbstractTemplateLoader
+{
+public:
+    /*!
+      Constructor
+    */
+    PrecompiledTemplateLoader();
+    ~PrecompiledTemplateLoader() override;
+
+    /*!
+     *
+     */
+    Template loadByName(const QString &name, Engine const *engine) const override;
+
+    /*!
+     *
+     */
+    bool canLoadTemplate(const QString &name) const override;
+
+    /*!
+     *
+     */
+    std::pair<QString, QString> getMediaUri(const QString &fileName) const override;
+
+    /*!
+      Maps the bundle \a fileName and makes its templates available. Bundles
+      are searched in the order in which they were added.
+
+      Returns false and sets \a errorString if the file is not a valid bundle.
+    */
+    bool addBundle(const QString &fileName, QString *errorString = nullptr);
+
+    /*!
+      The file names of the bundles added to this loader.
+    */
+    QStringList bundles() const;
+
+    /*!
+      The names of the templates in the bundles added to this loader.
+    */
+    QStringList templateNames() const;
+
+    /*!
+      Writes the \a templates, a map of template names to their content, as
+      a bundle to \a fileName. The templates are tokenized with smart
+      trimming if \a smartTrim is true.
+
+      Returns false and sets \a errorString if the file could not be written.
+    */
+    static bool writeBundle(const QString &fileName, const QHash<QString, QString> &templates, bool smartTrim = false, QString *errorString = nullptr);
+
+private:
+    Q_DECLARE_PRIVATE(PrecompiledTemplateLoader)
+    PrecompiledTemplateLoaderPrivate *const d_ptr;
+};
+
+class ArchiveTemplateLoaderPrivate;
+
+/*!
+  \class KTextTemplate::ArchiveTemplateLoader
+  \inheaderfile KTextTemplate/TemplateLoader
+  \inmodule KTextTemplate
+
+  \brief The ArchiveTemplateLoader loads Templates and media from a single
+  archive file.
+
+  An archive is a \c .kta file written by writeArchive from a directory of
+  templates and media, laid out like a template dir of a
+  FileSystemTemplateLoader. It is memory-mapped, and its files are found by
+  a binary search over its directory, so loading from it does not open or
+  stat any files.
+
+  \code
+    ArchiveTemplateLoader::writeArchive("themes.kta", "/path/to/templates");
+
+    auto loader = QSharedPointer<ArchiveTemplateLoader>::create();
+    loader->setArchive("themes.kta");
+    loader->setTheme("simple_theme");
+    engine->addTemplateLoader(loader);
+
+    // Loads simple_theme/mytemplate.html from the archive.
+    engine->loadByName("mytemplate.html");
+  \endcode
+
+  Media must be a local file to be used in the rendered output, so media is
+  extracted from the archive to the mediaDirectory the first time it is
+  asked for.
+
+  Archives are specific to the byte order of the machine which wrote them,
+  and are versioned. Archives which can not be read are rejected by
+  setArchive.
+*/
+class KTEXTTEMPLATE_EXPORT ArchiveTemplateLoader : public AbstractTemplateLoader
+{
+public:
+    /*!
+      Constructor
+    */
+    ArchiveTemplateLoader();
+    ~ArchiveTemplateLoader() override;
+
+    /*!
+     *
+     */
+    Template loadByName(const QString &name, Engine const *engine) const override;
+
+    /*!
+     *
+     */
+    bool canLoadTemplate(const QString &name) const override;
+
+    /*!
+     *
+     */
+    std::pair<QString, QString> getMediaUri(const QString &fileName) const override;
+
+    /*!
+      Maps the archive \a fileName and loads templates and media from it,
+      instead of from any previous archive.
+
+      Returns false and sets \a errorString if the file is not a valid
+      archive. The previous archive is kept in that case.
+    */
+    bool setArchive(const QString &fileName, QString *errorString = nullptr);
+
+    /*!
+      Returns the file name of the archive.
+    */
+    QString archive() const;
+
+    /*!
+      Sets the theme of this loader to \a themeName. Templates and media are
+      loaded from the directory \a themeName in the archive.
+    */
+    void setTheme(const QString &themeName);
+
+    /*!
+      Returns the theme of this loader.
+    */
+    QString themeName() const;
+
+    /*!
+      Sets the directory media is extracted to to \a directory.
+
+      By default, media is extracted to a temporary directory which is
+      removed with the loader.
+    */
+    void setMediaDirectory(const QString &directory);
+
+    /*!
+      Returns the directory media is extracted to, or an empty string if it
+      is a temporary directory.
+    */
+    QString mediaDirectory() const;
+
+    /*!
+      Returns the names of the files of the theme in the archive.
+    */
+    QStringList templateNames() const;
+
+    /*!
+      Writes the files in \a directory and its subdirectories as an archive
+      to \a fileName.
+
+      Returns false and sets \a errorString if a file could not be read or
+      the archive could not be written.
+    */
+    static bool writeArchive(const QString &fileName, const QString &directory, QString *errorString = nullptr);
+
+private:
+    Q_DECLARE_PRIVATE(ArchiveTemplateLoader)
+    ArchiveTemplateLoaderPrivate *const d_ptr;
+};
 }
 
 #endif
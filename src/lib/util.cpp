@@ -10,6 +10,7 @@
 #include "util.h"
 
 #include "metaenumvariable_p.h"
+#include "valuetype_p.h"
 
 #include <QAssociativeIterable>
 #include <QSequentialIterable>
@@ -71,11 +72,12 @@ bool KTextTemplate::variantIsTrue(const QVariant &variant)
     }
 
     // consider any non-empty generic container also "true", like the specific vairant types
-    if (variant.canConvert<QVariantList>()) {
+    const auto kind = ValueType::of(variant);
+    if (kind == ValueType::List) {
         const auto iterable = variant.value<QSequentialIterable>();
         return iterable.begin() != iterable.end();
     }
-    if (variant.canConvert<QVariantHash>()) {
+    if (kind == ValueType::Hash) {
         const auto iterable = variant.value<QAssociativeIterable>();
         return iterable.begin() != iterable.end();
     }
@@ -0,0 +1,150 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#include "valuetype_p.h"
+
+#include "metaenumvariable_p.h"
+#include "safestring.h"
+
+#include <QLocale>
+
+using namespace KTextTemplate;
+
+static ValueType::Kind probe(QMetaType type)
+{
+    // The same order in which MetaType::lookup used to try them.
+    if (QMetaType::canConvert(type, QMetaType::fromType<QObject *>()))
+        return ValueType::Object;
+    if (QMetaType::canConvert(type, QMetaType::fromType<QVariantList>()))
+        return ValueType::List;
+    if (QMetaType::canConvert(type, QMetaType::fromType<QVariantHash>()))
+        return ValueType::Hash;
+    if (type.flags().testFlag(QMetaType::IsGadget) && type.metaObject())
+        return ValueType::Gadget;
+    return ValueType::Other;
+}
+
+ValueType::Kind ValueType::of(QMetaType type)
+{
+    switch (type.id()) {
+    case QMetaType::UnknownType:
+        return Invalid;
+    case QMetaType::Bool:
+        return Bool;
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return Integer;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return Real;
+    case QMetaType::QString:
+        return String;
+    case QMetaType::QObjectStar:
+        return Object;
+    case QMetaType::QVariantList:
+    case QMetaType::QStringList:
+        return List;
+    case QMetaType::QVariantHash:
+    case QMetaType::QVariantMap:
+        return Hash;
+    }
+    if (type == QMetaType::fromType<KTextTemplate::SafeString>())
+        return SafeString;
+    if (type == QMetaType::fromType<MetaEnumVariable>())
+        return Enum;
+    // Pointers to QObject subclasses convert to QObject * without a
+    // registered converter, and are tried first, so this cannot change.
+    if (type.flags().testFlag(QMetaType::PointerToQObject))
+        return Object;
+    return probe(type);
+}
+
+RenderValue RenderValue::fromVariant(const QVariant &variant)
+{
+    RenderValue value;
+    switch (variant.userType()) {
+    case QMetaType::UnknownType:
+        break;
+    case QMetaType::Bool:
+        value.m_value = *static_cast<const bool *>(variant.constData());
+        break;
+    case QMetaType::Int:
+        value.m_value = *static_cast<const int *>(variant.constData());
+        break;
+    case QMetaType::LongLong:
+        value.m_value = *static_cast<const qint64 *>(variant.constData());
+        break;
+    case QMetaType::Double:
+        value.m_value = *static_cast<const double *>(variant.constData());
+        break;
+    case QMetaType::QString:
+        value.m_value = *static_cast<const QString *>(variant.constData());
+        break;
+    case QMetaType::QObjectStar:
+        value.m_value = *static_cast<QObject *const *>(variant.constData());
+        break;
+    default:
+        if (variant.metaType() == QMetaType::fromType<KTextTemplate::SafeString>())
+            value.m_value = *static_cast<const KTextTemplate::SafeString *>(variant.constData());
+        else
+            value.m_value = variant;
+    }
+    return value;
+}
+
+QVariant RenderValue::toVariant() const
+{
+    switch (type()) {
+    case Invalid:
+        return {};
+    case Bool:
+        return std::get<bool>(m_value);
+    case Int:
+        return std::get<int>(m_value);
+    case LongLong:
+        return QVariant::fromValue(std::get<qint64>(m_value));
+    case Double:
+        return std::get<double>(m_value);
+    case String:
+        return std::get<QString>(m_value);
+    case SafeString:
+        return QVariant::fromValue(std::get<KTextTemplate::SafeString>(m_value));
+    case Object:
+        return QVariant::fromValue(std::get<QObject *>(m_value));
+    case Variant:
+        return std::get<QVariant>(m_value);
+    }
+    Q_UNREACHABLE_RETURN({});
+}
+
+KTextTemplate::SafeString RenderValue::toSafeString() const
+{
+    // The same strings QVariant converts these types to.
+    switch (type()) {
+    case Bool:
+        return std::get<bool>(m_value) ? QStringLiteral("true") : QStringLiteral("false");
+    case Int:
+        return QString::number(std::get<int>(m_value));
+    case LongLong:
+        return QString::number(std::get<qint64>(m_value));
+    case Double:
+        return QString::number(std::get<double>(m_value), 'g', QLocale::FloatingPointShortest);
+    case String:
+        return std::get<QString>(m_value);
+    case SafeString:
+        return std::get<KTextTemplate::SafeString>(m_value);
+    case Invalid:
+    case Object:
+    case Variant:
+        break;
+    }
+    return {};
+}
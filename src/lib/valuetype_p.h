@@ -0,0 +1,107 @@
+/*
+  This file is part of the KTextTemplate library
+
+  SPDX-FileCopyrightText: 2026 The KTextTemplate Authors
+
+  SPDX-License-Identifier: LGPL-2.1-or-later
+
+*/
+
+#ifndef KTEXTTEMPLATE_VALUETYPE_P_H
+#define KTEXTTEMPLATE_VALUETYPE_P_H
+
+#include "safestring.h"
+
+#include <QVariant>
+
+#include <variant>
+
+namespace KTextTemplate
+{
+
+/*
+  Classifies the values passed through the render pipeline by what the
+  engine does with them.
+
+  The built-in types are classified by their type id. Other types are probed
+  with QVariant::canConvert each time, as a converter registered later may
+  change the result.
+*/
+class ValueType
+{
+public:
+    enum Kind : quint8 {
+        Invalid,
+        Bool,
+        Integer,
+        Real,
+        String,
+        SafeString,
+        Enum,
+        Object,
+        List,
+        Hash,
+        Gadget,
+        Other,
+    };
+
+    static Kind of(const QVariant &value)
+    {
+        return of(value.metaType());
+    }
+
+    static Kind of(QMetaType type);
+};
+
+/*
+  A value rendered by a Variable or FilterExpression.
+
+  The scalar types, strings and QObjects are held directly, without the
+  QVariant they were inserted into the Context as, so that rendering them
+  needs neither the metatype system nor a heap allocation of their own. Only
+  other types, such as lists and hashes, are kept in a QVariant.
+
+  Values are converted to QVariants only where they reach the public API,
+  such as filters and the lookups of properties.
+*/
+class RenderValue
+{
+public:
+    // In the order of the alternatives of m_value.
+    enum Type : quint8 {
+        Invalid,
+        Bool,
+        Int,
+        LongLong,
+        Double,
+        String,
+        SafeString,
+        Object,
+        Variant,
+    };
+
+    RenderValue() = default;
+
+    static RenderValue fromVariant(const QVariant &variant);
+    QVariant toVariant() const;
+
+    Type type() const
+    {
+        return static_cast<Type>(m_value.index());
+    }
+
+    bool isValid() const
+    {
+        return type() != Invalid;
+    }
+
+    // The string which the value renders as, for all types but Object and
+    // Variant.
+    KTextTemplate::SafeString toSafeString() const;
+
+private:
+    std::variant<std::monostate, bool, int, qint64, double, QString, KTextTemplate::SafeString, QObject *, QVariant> m_value;
+};
+}
+
+#endif
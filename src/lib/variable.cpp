@@ -14,7 +14,9 @@
 #include "exception.h"
 #include "metaenumvariable_p.h"
 #include "metatype.h"
+#include "symboltable_p.h"
 #include "util.h"
+#include "valuetype_p.h"
 
 #include <QMetaEnum>
 #include <QStringList>
@@ -37,7 +39,11 @@ public:
 
     QString m_varString;
     QVariant m_literal;
+    // The literal as it is rendered.
+    RenderValue m_renderLiteral;
     QStringList m_lookups;
+    // The symbol of the first lookup, which is looked up in the Context.
+    int m_symbol = SymbolTable::NoSymbol;
     bool m_localize = false;
 };
 }
@@ -64,7 +70,9 @@ Variable &Variable::operator=(const Variable &other)
         return *this;
     d_ptr->m_varString = other.d_ptr->m_varString;
     d_ptr->m_literal = other.d_ptr->m_literal;
+    d_ptr->m_renderLiteral = other.d_ptr->m_renderLiteral;
     d_ptr->m_lookups = other.d_ptr->m_lookups;
+    d_ptr->m_symbol = other.d_ptr->m_symbol;
     d_ptr->m_localize = other.d_ptr->m_localize;
     return *this;
 }
@@ -112,8 +120,10 @@ Variable::Variable(const QString &var)
                 throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Variables and attributes may not begin with underscores: %1").arg(localVar));
             }
             d->m_lookups = localVar.split(QLatin1Char('.'));
+            d->m_symbol = SymbolTable::intern(d->m_lookups.first());
         }
     }
+    d->m_renderLiteral = RenderValue::fromVariant(d->m_literal);
 }
 
 bool Variable::isValid() const
@@ -201,7 +211,8 @@ QVariant Variable::resolve(Context *c) const
                 return {};
 
         } else {
-            var = c->lookup(d->m_lookups.at(i++));
+            var = c->lookupSymbol(d->m_symbol, d->m_lookups.first());
+            ++i;
         }
         while (i < d->m_lookups.size()) {
             var = MetaType::lookup(var, d->m_lookups.at(i++));
@@ -209,10 +220,8 @@ QVariant Variable::resolve(Context *c) const
                 return {};
         }
     } else {
-        if (isSafeString(d->m_literal))
-            var = QVariant::fromValue(getSafeString(d->m_literal));
-        else
-            var = d->m_literal;
+        // Literals are numbers or SafeStrings already.
+        var = d->m_literal;
     }
 
     if (d->m_localize) {
@@ -220,3 +229,15 @@ QVariant Variable::resolve(Context *c) const
     }
     return var;
 }
+
+RenderValue Variable::resolveValue(Context *c) const
+{
+    Q_D(const Variable);
+    if (d->m_lookups.isEmpty() && !d->m_localize)
+        return d->m_renderLiteral;
+    // Only a plain name is rendered straight from the Context. Properties,
+    // Qt enums and localized values go through their QVariant API.
+    if (d->m_lookups.size() != 1 || d->m_localize || d->m_lookups.first() == QLatin1String("Qt"))
+        return RenderValue::fromVariant(resolve(c));
+    return c->lookupRenderValue(d->m_symbol, d->m_lookups.first());
+}
@@ -17,6 +17,7 @@
 namespace KTextTemplate
 {
 class Context;
+class RenderValue;
 
 class VariablePrivate;
 
@@ -102,6 +103,11 @@ public:
     QStringList lookups() const;
 
 private:
+    // Resolves the Variable without converting the values which the Context
+    // holds to QVariants.
+    KTEXTTEMPLATE_NO_EXPORT RenderValue resolveValue(Context *c) const;
+    friend class FilterExpression;
+
     Q_DECLARE_PRIVATE(Variable)
     VariablePrivate *const d_ptr;
 };
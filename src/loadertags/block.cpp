@@ -11,6 +11,7 @@
 
 #include "blockcontext.h"
 #include "exception.h"
+#include "nodebuiltins_p.h"
 #include "parser.h"
 #include "rendercontext.h"
 #include "util.h"
@@ -63,7 +64,23 @@ Node *BlockNodeFactory::getNode(const QString &tagContent, Parser *p) const
         p->invalidBlockTag(endBlock, QStringLiteral("endblock"), acceptableBlocks);
     }
 
-    n->setNodeList(list);
+    // Plain {{ block.super }} variables render the overridden block straight
+    // to the output.
+    NodeList nodes;
+    for (auto node : list) {
+        const auto variableNode = qobject_cast<VariableNode *>(node);
+        if (variableNode) {
+            const auto fe = variableNode->filterExpression();
+            if (fe.filters().isEmpty() && !fe.variable().isLocalized()
+                && fe.variable().lookups() == QStringList{QStringLiteral("block"), QStringLiteral("super")}) {
+                node = new BlockSuperNode(fe, n);
+                node->setLineNumber(variableNode->lineNumber());
+                delete variableNode;
+            }
+        }
+        nodes.append(node);
+    }
+    n->setNodeList(nodes);
 
     return n;
 }
@@ -71,7 +88,6 @@ Node *BlockNodeFactory::getNode(const QString &tagContent, Parser *p) const
 BlockNode::BlockNode(const QString &name, QObject *parent)
     : Node(parent)
     , m_name(name)
-    , m_stream(nullptr)
 {
     qRegisterMetaType<KTextTemplate::SafeString>("KTextTemplate::SafeString");
 }
@@ -85,57 +101,74 @@ void BlockNode::setNodeList(const NodeList &list) const
 
 void BlockNode::render(OutputStream *stream, Context *c) const
 {
-    QVariant &variant = c->renderContext()->data(BLOCK_CONTEXT_KEY);
-    auto blockContext = variant.value<BlockContext>();
+    // The block context is modified in place rather than copied, as it
+    // would otherwise be detached by each block.
+    auto &blockContext = BlockContext::current(c);
 
     c->push();
 
-    if (blockContext.isEmpty()) {
-        m_context = c;
-        m_stream = stream;
-        c->insert(QStringLiteral("block"), QVariant::fromValue(const_cast<QObject *>(static_cast<const QObject *>(this))));
-        m_list.render(stream, c);
-        m_stream = nullptr;
-    } else {
-        auto block = static_cast<const BlockNode *>(blockContext.pop(m_name));
-        variant.setValue(blockContext);
-        auto push = block;
-        if (!block)
-            block = this;
-
-        const auto list = block->m_list;
-
-        block = new BlockNode(block->m_name, nullptr);
-        block->setNodeList(list);
-        block->m_context = c;
-        block->m_stream = stream;
-        c->insert(QStringLiteral("block"), QVariant::fromValue(const_cast<QObject *>(static_cast<const QObject *>(block))));
-        list.render(stream, c);
-
-        delete block;
-        if (push) {
-            blockContext.push(m_name, push);
-            variant.setValue(blockContext);
-        }
-    }
+    const BlockNode *push = nullptr;
+    if (!blockContext.isEmpty())
+        push = blockContext.pop(m_name);
+    const auto block = push ? push : this;
+
+    BlockRender render{block, c, stream};
+    c->insert(QStringLiteral("block"), QVariant::fromValue(BlockVariable(&render)));
+    block->m_list.render(stream, c);
+
+    if (push)
+        BlockContext::current(c).push(m_name, push);
     c->pop();
 }
 
-SafeString BlockNode::getSuper() const
+BlockVariable::BlockVariable(BlockRender *render)
+    : m_render(render)
 {
-    if (m_context->renderContext()->contains(BLOCK_CONTEXT_KEY)) {
-        QVariant &variant = m_context->renderContext()->data(BLOCK_CONTEXT_KEY);
-        const auto blockContext = variant.value<BlockContext>();
-        auto block = blockContext.getBlock(m_name);
-        if (block) {
-            QString superContent;
-            QTextStream superTextStream(&superContent);
-            auto superStream = m_stream->clone(&superTextStream);
-            const_cast<BlockNode *>(this)->render(superStream.data(), m_context);
-            return markSafe(superContent);
-        }
+}
+
+bool BlockVariable::hasSuper() const
+{
+    const auto c = m_render->context;
+    return c->renderContext()->contains(BLOCK_CONTEXT_KEY) && BlockContext::current(c).getBlock(m_render->block->name());
+}
+
+SafeString BlockVariable::getSuper() const
+{
+    if (!hasSuper())
+        return {};
+
+    // Rendered each time, as the overridden block may have side effects on
+    // the render, such as advancing a cycle.
+    QString superContent;
+    QTextStream superTextStream(&superContent);
+    auto superStream = m_render->stream->clone(&superTextStream);
+    m_render->block->render(superStream.data(), m_render->context);
+    return markSafe(superContent);
+}
+
+void BlockVariable::renderSuper(OutputStream *stream) const
+{
+    if (hasSuper())
+        m_render->block->render(stream, m_render->context);
+}
+
+BlockSuperNode::BlockSuperNode(const FilterExpression &fe, QObject *parent)
+    : Node(parent)
+    , m_filterExpression(fe)
+{
+}
+
+void BlockSuperNode::render(OutputStream *stream, Context *c) const
+{
+    const auto block = c->lookup(QStringLiteral("block"));
+    if (block.metaType() == QMetaType::fromType<BlockVariable>()) {
+        block.value<BlockVariable>().renderSuper(stream);
+        return;
     }
-    return {};
+    // Another variable called block, rendered like any variable.
+    const auto v = m_filterExpression.resolve(c);
+    if (v.isValid())
+        streamValueInContext(stream, v, c);
 }
 
 NodeList BlockNode::nodeList() const
@@ -11,6 +11,7 @@
 #define BLOCKNODE_H
 
 #include "node.h"
+#include "safestring.h"
 
 namespace KTextTemplate
 {
@@ -31,7 +32,6 @@ public:
 class BlockNode : public Node
 {
     Q_OBJECT
-    Q_PROPERTY(KTextTemplate::SafeString super READ getSuper)
 public:
     explicit BlockNode(const QString &blockName, QObject *parent = {});
     ~BlockNode() override;
@@ -44,17 +44,66 @@ public:
 
     NodeList nodeList() const;
 
-    // Q_SLOTS
-    /**
-    Returns the block overridden by this one rendered in context.
+private:
+    const QString m_name;
+    mutable NodeList m_list;
+};
+
+/*
+  A block being rendered, where block is the node whose content is rendered.
+*/
+struct BlockRender {
+    const BlockNode *block;
+    Context *context;
+    OutputStream *stream;
+};
+
+/*
+  The block variable in the context of a block being rendered.
+
+  It is a small value rather than a QObject, so that rendering a block does
+  not allocate an object to represent it.
+*/
+class BlockVariable
+{
+    Q_GADGET
+    Q_PROPERTY(KTextTemplate::SafeString super READ getSuper)
+public:
+    explicit BlockVariable(BlockRender *render = nullptr);
+
+    /*
+      Returns the block overridden by this one rendered in context.
     */
     SafeString getSuper() const;
 
+    /*
+      Renders the block overridden by this one to stream, without rendering
+      it to a string first.
+    */
+    void renderSuper(OutputStream *stream) const;
+
 private:
-    const QString m_name;
-    mutable NodeList m_list;
-    mutable Context *m_context;
-    mutable OutputStream *m_stream;
+    bool hasSuper() const;
+
+    BlockRender *m_render;
 };
 
+/*
+  A {{ block.super }} variable directly in a block, which renders the
+  overridden block to the output.
+*/
+class BlockSuperNode : public Node
+{
+    Q_OBJECT
+public:
+    explicit BlockSuperNode(const FilterExpression &fe, QObject *parent = {});
+
+    void render(OutputStream *stream, Context *c) const override;
+
+private:
+    FilterExpression m_filterExpression;
+};
+
+Q_DECLARE_METATYPE(BlockVariable)
+
 #endif
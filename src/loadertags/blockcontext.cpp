@@ -10,9 +10,41 @@
 #include "blockcontext.h"
 
 #include "block.h"
+#include "context.h"
+#include "rendercontext.h"
+
+#include <algorithm>
+
+BlockContext &BlockContext::current(KTextTemplate::Context *c)
+{
+    // Kept under the null node by all the loader tags.
+    auto &variant = c->renderContext()->data(nullptr);
+    if (variant.metaType() != QMetaType::fromType<BlockContext>())
+        variant.setValue(BlockContext());
+    return *static_cast<BlockContext *>(variant.data());
+}
+
+BlockTable::BlockTable(const QList<QHash<QString, BlockNode *>> &levels)
+{
+    // As BlockContext::addBlocks adds each level in turn.
+    for (const auto &level : levels) {
+        for (auto it = level.constBegin(); it != level.constEnd(); ++it) {
+            auto slot = m_slots.value(it.key(), -1);
+            if (slot < 0) {
+                slot = int(m_blocks.size());
+                m_slots.insert(it.key(), slot);
+                m_names.append(it.key());
+                m_blocks.append({});
+            }
+            m_blocks[slot].prepend(it.value());
+        }
+    }
+}
 
 void BlockContext::addBlocks(const QHash<QString, BlockNode *> &blocks)
 {
+    detachTable();
+
     auto it = blocks.constBegin();
     const auto end = blocks.constEnd();
 
@@ -21,8 +53,45 @@ void BlockContext::addBlocks(const QHash<QString, BlockNode *> &blocks)
     }
 }
 
+void BlockContext::setTable(const std::shared_ptr<const BlockTable> &table)
+{
+    m_blocks.clear();
+    m_table = table;
+    m_depths.resize(table->size());
+    for (auto slot = 0; slot < table->size(); ++slot)
+        m_depths[slot] = table->blocks(slot).size();
+}
+
+bool BlockContext::usesTable(const BlockTable *table) const
+{
+    if (m_table.get() != table)
+        return false;
+    for (auto slot = 0; slot < table->size(); ++slot) {
+        if (m_depths.at(slot) != table->blocks(slot).size())
+            return false;
+    }
+    return true;
+}
+
+void BlockContext::detachTable()
+{
+    if (!m_table)
+        return;
+    for (auto slot = 0; slot < m_table->size(); ++slot)
+        m_blocks.insert(m_table->name(slot), m_table->blocks(slot).first(m_depths.at(slot)));
+    m_table.reset();
+    m_depths.clear();
+}
+
 BlockNode *BlockContext::getBlock(const QString &name) const
 {
+    if (m_table) {
+        const auto slot = m_table->slot(name);
+        if (slot < 0 || m_depths.at(slot) == 0)
+            return nullptr;
+        return m_table->blocks(slot).at(m_depths.at(slot) - 1);
+    }
+
     auto list = m_blocks[name];
     if (list.isEmpty())
         return nullptr;
@@ -32,6 +101,13 @@ BlockNode *BlockContext::getBlock(const QString &name) const
 
 BlockNode *BlockContext::pop(const QString &name)
 {
+    if (m_table) {
+        const auto slot = m_table->slot(name);
+        if (slot < 0 || m_depths.at(slot) == 0)
+            return nullptr;
+        return m_table->blocks(slot).at(--m_depths[slot]);
+    }
+
     QList<BlockNode *> &list = m_blocks[name];
     if (list.isEmpty())
         return nullptr;
@@ -40,16 +116,46 @@ BlockNode *BlockContext::pop(const QString &name)
 
 void BlockContext::push(const QString &name, BlockNode const *blockNode)
 {
+    if (m_table) {
+        // Blocks are usually put back where they were taken from.
+        const auto slot = m_table->slot(name);
+        if (slot >= 0) {
+            auto &depth = m_depths[slot];
+            const auto &blocks = m_table->blocks(slot);
+            if (depth < blocks.size() && blocks.at(depth) == blockNode) {
+                ++depth;
+                return;
+            }
+        }
+        detachTable();
+    }
     m_blocks[name].append(const_cast<BlockNode *>(blockNode));
 }
 
 bool BlockContext::isEmpty() const
 {
+    if (m_table)
+        return m_table->size() == 0;
     return m_blocks.isEmpty();
 }
 
 void BlockContext::remove(QList<BlockNode *> const &nodes)
 {
+    if (m_table) {
+        // Included templates remove blocks which are usually not in the table.
+        const auto inTable = std::any_of(nodes.cbegin(), nodes.cend(), [this](BlockNode *node) {
+            const auto slot = m_table->slot(node->name());
+            if (slot < 0)
+                return false;
+            const auto &blocks = m_table->blocks(slot);
+            const auto end = blocks.cbegin() + m_depths.at(slot);
+            return std::find(blocks.cbegin(), end, node) != end;
+        });
+        if (!inTable)
+            return;
+        detachTable();
+    }
+
     for (auto node : nodes) {
         m_blocks[node->name()].removeOne(node);
         if (m_blocks[node->name()].isEmpty()) {
@@ -12,14 +12,79 @@
 
 #include <QHash>
 #include <QMetaType>
+#include <QVarLengthArray>
+
+#include <memory>
 
 class BlockNode;
 
+namespace KTextTemplate
+{
+class Context;
+}
+
+/*
+  The blocks of a flattened inheritance chain. For each name, the blocks are
+  ordered from the overridden one to the one which overrides it last, as a
+  BlockContext holds them. It is built once for each chain, and shared by all
+  the renders of it.
+*/
+class BlockTable
+{
+public:
+    // The levels are the blocks of each template, from the extending one up.
+    explicit BlockTable(const QList<QHash<QString, BlockNode *>> &levels);
+
+    // Returns the index of the blocks called name, or -1.
+    int slot(const QString &name) const
+    {
+        return m_slots.value(name, -1);
+    }
+
+    const QList<BlockNode *> &blocks(int slot) const
+    {
+        return m_blocks.at(slot);
+    }
+
+    QString name(int slot) const
+    {
+        return m_names.at(slot);
+    }
+
+    int size() const
+    {
+        return int(m_blocks.size());
+    }
+
+private:
+    QHash<QString, int> m_slots;
+    QList<QString> m_names;
+    QList<QList<BlockNode *>> m_blocks;
+};
+
 class BlockContext
 {
 public:
+    /*
+      Returns the BlockContext of the render of c, to be modified in place.
+      The reference is only valid until further nodes are rendered.
+    */
+    static BlockContext &current(KTextTemplate::Context *c);
+
     void addBlocks(const QHash<QString, BlockNode *> &blocks);
 
+    /*
+      Replaces the blocks with those of table. The blocks are then taken and
+      put back by their index in it, rather than copied into the context.
+    */
+    void setTable(const std::shared_ptr<const BlockTable> &table);
+
+    /*
+      Returns whether the blocks are still all those of table, as set by
+      setTable.
+    */
+    bool usesTable(const BlockTable *table) const;
+
     BlockNode *pop(const QString &name);
 
     void push(const QString &name, BlockNode const *blockNode);
@@ -31,6 +96,14 @@ public:
     void remove(QList<BlockNode *> const &nodes);
 
 private:
+    // Copies the blocks which remain from the table, to modify them in ways
+    // the table does not support.
+    void detachTable();
+
+    std::shared_ptr<const BlockTable> m_table;
+    // The number of the blocks of each slot of m_table which are in the
+    // context.
+    QVarLengthArray<int, 16> m_depths;
     QHash<QString, QList<BlockNode *>> m_blocks;
 };
 
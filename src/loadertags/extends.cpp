@@ -13,9 +13,9 @@
 #include "blockcontext.h"
 #include "engine.h"
 #include "exception.h"
+#include "include.h"
 #include "nodebuiltins_p.h"
 #include "parser.h"
-#include "rendercontext.h"
 #include "util.h"
 
 using namespace KTextTemplate;
@@ -48,6 +48,13 @@ Node *ExtendsNodeFactory::getNode(const QString &tagContent, Parser *p) const
         throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Extends tag may only appear once in a template."));
     }
 
+    const auto &parentName = expr.at(1);
+    if (parentName.size() >= 2
+        && ((parentName.startsWith(QLatin1Char('"')) && parentName.endsWith(QLatin1Char('"')))
+            || (parentName.startsWith(QLatin1Char('\'')) && parentName.endsWith(QLatin1Char('\''))))) {
+        n->setParentTemplate(loadConstantTemplate(parentName.mid(1, parentName.size() - 2), p));
+    }
+
     return n;
 }
 
@@ -81,8 +88,88 @@ void ExtendsNode::setNodeList(const NodeList &list)
     m_blocks = createNodeMap(blockList);
 }
 
+// Returns whether t is the root of the inheritance, which is when its first
+// tag is not an extends tag.
+static bool isRootTemplate(const Template &t)
+{
+    for (auto n : t->nodeList()) {
+        if (!qobject_cast<TextNode *>(n))
+            return !qobject_cast<ExtendsNode *>(n);
+    }
+    return false;
+}
+
+void ExtendsNode::setParentTemplate(const Template &t)
+{
+    m_parent = t;
+    m_chain = t ? createChain(t) : nullptr;
+}
+
+std::shared_ptr<const ExtendsNode::Chain> ExtendsNode::createChain(const Template &t) const
+{
+    auto chain = std::make_shared<Chain>();
+    chain->parent = t;
+    chain->generation = t->generation();
+    chain->levels.append(m_blocks);
+    chain->parentBlocks = t->findChildren<BlockNode *>();
+
+    ExtendsNode *parentExtends = nullptr;
+    for (auto n : t->nodeList()) {
+        if (!qobject_cast<TextNode *>(n)) {
+            parentExtends = qobject_cast<ExtendsNode *>(n);
+            break;
+        }
+    }
+
+    if (parentExtends && parentExtends->m_chain) {
+        // The parent was parsed first, so its chain is already flattened.
+        for (auto n : t->nodeList()) {
+            if (n == parentExtends)
+                break;
+            chain->leadingNodes.append(n);
+        }
+        const auto &parentChain = *parentExtends->m_chain;
+        chain->last = parentChain.last;
+        chain->leadingNodes.append(parentChain.leadingNodes);
+        chain->levels.append(parentChain.levels);
+        chain->parentBlocks.append(parentChain.parentBlocks);
+    } else {
+        chain->last = t.data();
+        if (isRootTemplate(t))
+            chain->levels.append(createNodeMap(chain->parentBlocks));
+    }
+
+    chain->blocks = std::make_shared<BlockTable>(chain->levels);
+    chain->ownBlocks = std::make_shared<BlockTable>(QList<QHash<QString, BlockNode *>>{m_blocks});
+    return chain;
+}
+
+std::shared_ptr<const ExtendsNode::Chain> ExtendsNode::chainFor(const Template &t) const
+{
+    const QMutexLocker locker(&m_chainsMutex);
+    if (const auto it = m_chains.constFind(t.data()); it != m_chains.constEnd()) {
+        const auto &chain = it.value();
+        // Another template may have been created where a destroyed one was.
+        if (chain->generation == t->generation() && chain->parent.toStrongRef() == t)
+            return chain;
+    }
+
+    for (auto it = m_chains.begin(); it != m_chains.end();) {
+        if (it.value()->parent.isNull())
+            it = m_chains.erase(it);
+        else
+            ++it;
+    }
+    const auto chain = createChain(t);
+    m_chains.insert(t.data(), chain);
+    return chain;
+}
+
 Template ExtendsNode::getParent(Context *c) const
 {
+    if (m_parent)
+        return m_parent;
+
     const auto parentVar = m_filterExpression.resolve(c);
     if (parentVar.userType() == qMetaTypeId<KTextTemplate::Template>()) {
         return parentVar.value<Template>();
@@ -105,38 +192,43 @@ Template ExtendsNode::getParent(Context *c) const
 
 void ExtendsNode::render(OutputStream *stream, Context *c) const
 {
+    if (m_chain) {
+        renderChain(*m_chain, stream, c);
+        return;
+    }
+
     const auto parentTemplate = getParent(c);
 
     if (!parentTemplate) {
         throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Cannot load template."));
     }
 
-    QVariant &variant = c->renderContext()->data(nullptr);
-    auto blockContext = variant.value<BlockContext>();
-    blockContext.addBlocks(m_blocks);
-    variant.setValue(blockContext);
-
-    const auto nodeList = parentTemplate->nodeList();
-
-    const auto parentBlocks = createNodeMap(parentTemplate->findChildren<BlockNode *>());
+    // Kept alive for the render, as another thread may replace it.
+    const auto chain = chainFor(parentTemplate);
+    renderChain(*chain, stream, c);
+}
 
-    for (auto n : nodeList) {
-        auto tn = qobject_cast<TextNode *>(n);
-        if (!tn) {
-            auto en = qobject_cast<ExtendsNode *>(n);
-            if (!en) {
-                blockContext.addBlocks(parentBlocks);
-                variant.setValue(blockContext);
-            }
-            break;
-        }
+void ExtendsNode::renderChain(const Chain &chain, OutputStream *stream, Context *c) const
+{
+    auto &blockContext = BlockContext::current(c);
+    if (blockContext.isEmpty()) {
+        // The usual case of a template which is not itself included in a
+        // block, where the blocks are taken from the table of the chain by
+        // index rather than copied.
+        blockContext.setTable(chain.blocks);
+    } else {
+        for (const auto &level : chain.levels)
+            blockContext.addBlocks(level);
     }
-    variant.setValue(blockContext);
-    parentTemplate->nodeList().render(stream, c);
 
-    auto nodes = parentTemplate->findChildren<BlockNode *>();
-    blockContext.remove(nodes);
-    variant.setValue(blockContext);
+    chain.leadingNodes.render(stream, c);
+    chain.last->nodeList().render(stream, c);
+
+    auto &renderedContext = BlockContext::current(c);
+    if (renderedContext.usesTable(chain.blocks.get()))
+        renderedContext.setTable(chain.ownBlocks);
+    else
+        renderedContext.remove(chain.parentBlocks);
 }
 
 void ExtendsNode::appendNode(Node *node)
@@ -10,9 +10,14 @@
 #ifndef EXTENDSNODE_H
 #define EXTENDSNODE_H
 
+#include "blockcontext.h"
 #include "node.h"
 #include "template.h"
 
+#include <QMutex>
+
+#include <memory>
+
 namespace KTextTemplate
 {
 class Parser;
@@ -40,6 +45,8 @@ public:
 
     void setNodeList(const NodeList &list);
 
+    void setParentTemplate(const Template &t);
+
     void render(OutputStream *stream, Context *c) const override;
 
     void appendNode(Node *node);
@@ -52,9 +59,44 @@ public:
     }
 
 private:
+    // The chain of templates above this one. It is flattened as far as the
+    // parents were resolved when parsing, so that rendering adds the blocks of
+    // all of them at once and renders the last template directly instead of
+    // going through each extends node.
+    struct Chain {
+        // The parent, and the version of it the chain was built from.
+        QWeakPointer<TemplateImpl> parent;
+        quint64 generation = 0;
+        // The template which is rendered. The parent keeps it alive.
+        TemplateImpl *last = nullptr;
+        // The text before the extends tags of the templates in between.
+        NodeList leadingNodes;
+        // The blocks each template in the chain adds, from this one up.
+        QList<QHash<QString, BlockNode *>> levels;
+        // All the levels, which an empty BlockContext renders with.
+        std::shared_ptr<const BlockTable> blocks;
+        // The blocks of this template only, which are left after rendering.
+        std::shared_ptr<const BlockTable> ownBlocks;
+        // The blocks removed after rendering, which are all but those of
+        // this template.
+        QList<BlockNode *> parentBlocks;
+    };
+
+    std::shared_ptr<const Chain> createChain(const Template &t) const;
+    std::shared_ptr<const Chain> chainFor(const Template &t) const;
+    void renderChain(const Chain &chain, OutputStream *stream, Context *c) const;
+
     FilterExpression m_filterExpression;
     NodeList m_list;
     QHash<QString, BlockNode *> m_blocks;
+
+    // The parent, if it was resolved when parsing, and its chain.
+    Template m_parent;
+    std::shared_ptr<const Chain> m_chain;
+
+    // The chains of the parents resolved when rendering, by parent.
+    mutable QMutex m_chainsMutex;
+    mutable QHash<const TemplateImpl *, std::shared_ptr<const Chain>> m_chains;
 };
 
 #endif
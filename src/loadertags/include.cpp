@@ -14,7 +14,6 @@
 #include "engine.h"
 #include "exception.h"
 #include "parser.h"
-#include "rendercontext.h"
 #include "template.h"
 #include "util.h"
 
@@ -32,7 +31,10 @@ Node *IncludeNodeFactory::getNode(const QString &tagContent, Parser *p) const
 
     if ((includeName.startsWith(QLatin1Char('"')) && includeName.endsWith(QLatin1Char('"')))
         || (includeName.startsWith(QLatin1Char('\'')) && includeName.endsWith(QLatin1Char('\'')))) {
-        return new ConstantIncludeNode(includeName.mid(1, size - 2));
+        const auto name = includeName.mid(1, size - 2);
+        auto n = new ConstantIncludeNode(name);
+        n->setTemplate(loadConstantTemplate(name, p));
+        return n;
     }
     return new IncludeNode(FilterExpression(includeName, p), p);
 }
@@ -54,13 +56,11 @@ void IncludeNode::render(OutputStream *stream, Context *c) const
     if (!t)
         throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Template not found %1").arg(filename));
 
-    if (t->error())
-        throw KTextTemplate::Exception(t->error(), t->errorString());
-
-    t->render(stream, c);
-
-    if (t->error())
-        throw KTextTemplate::Exception(t->error(), t->errorString());
+    // tryRender also reports errors of compiling the template, and does not
+    // touch its error state, which other renders may be using.
+    const auto result = t->tryRender(stream, c);
+    if (result.error())
+        throw KTextTemplate::Exception(result.error(), result.errorString());
 }
 
 ConstantIncludeNode::ConstantIncludeNode(const QString &name, QObject *parent)
@@ -69,27 +69,54 @@ ConstantIncludeNode::ConstantIncludeNode(const QString &name, QObject *parent)
     m_name = name;
 }
 
-void ConstantIncludeNode::render(OutputStream *stream, Context *c) const
+void ConstantIncludeNode::setTemplate(const Template &t)
 {
-    auto ti = containerTemplate();
+    m_template = t;
+    m_blocks = t ? t->findChildren<BlockNode *>() : QList<BlockNode *>();
+}
 
-    auto t = ti->engine()->loadByName(m_name);
-    if (!t)
-        throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Template not found %1").arg(m_name));
+void ConstantIncludeNode::render(OutputStream *stream, Context *c) const
+{
+    auto t = m_template;
+    if (!t) {
+        t = containerTemplate()->engine()->loadByName(m_name);
+        if (!t)
+            throw KTextTemplate::Exception(TagSyntaxError, QStringLiteral("Template not found %1").arg(m_name));
+    }
 
-    if (t->error())
-        throw KTextTemplate::Exception(t->error(), t->errorString());
+    const auto result = t->tryRender(stream, c);
+    if (result.error())
+        throw KTextTemplate::Exception(result.error(), result.errorString());
 
-    t->render(stream, c);
+    BlockContext::current(c).remove(m_template ? m_blocks : t->findChildren<BlockNode *>());
+}
 
-    if (t->error())
-        throw KTextTemplate::Exception(t->error(), t->errorString());
+Template loadConstantTemplate(const QString &name, Parser *p)
+{
+    const auto t = qobject_cast<TemplateImpl *>(p->parent());
+    if (!t || !t->engine()->constantTemplateResolutionEnabled())
+        return {};
+
+    // The templates whose targets are being loaded by this thread. Templates
+    // which include themselves, usually in a condition, are left to be loaded
+    // when rendering, as loading them here would never finish.
+    thread_local QStringList s_resolving;
+    if (name == t->objectName() || s_resolving.contains(name))
+        return {};
+
+    s_resolving.append(t->objectName());
+    Template resolved;
+    try {
+        resolved = t->engine()->loadByName(name);
+    } catch (...) {
+        s_resolving.removeLast();
+        throw;
+    }
+    s_resolving.removeLast();
 
-    QVariant &variant = c->renderContext()->data(nullptr);
-    auto blockContext = variant.value<BlockContext>();
-    auto nodes = t->findChildren<BlockNode *>();
-    blockContext.remove(nodes);
-    variant.setValue(blockContext);
+    if (!resolved || resolved->error())
+        return {};
+    return resolved;
 }
 
 #include "moc_include.cpp"
@@ -11,12 +11,15 @@
 #define INCLUDENODE_H
 
 #include "node.h"
+#include "template.h"
 
 namespace KTextTemplate
 {
 class Parser;
 }
 
+class BlockNode;
+
 using namespace KTextTemplate;
 
 class IncludeNodeFactory : public AbstractNodeFactory
@@ -44,10 +47,22 @@ class ConstantIncludeNode : public Node
     Q_OBJECT
 public:
     explicit ConstantIncludeNode(const QString &filename, QObject *parent = {});
+
+    void setTemplate(const Template &t);
+
     void render(OutputStream *stream, Context *c) const override;
 
 private:
     QString m_name;
+    Template m_template;
+    QList<BlockNode *> m_blocks;
 };
 
+/*
+  Loads the template called name for a tag which p is parsing, if the Engine
+  resolves constant templates. Returns a null Template if it is not resolved,
+  so that it is loaded and any error is reported when rendering.
+*/
+Template loadConstantTemplate(const QString &name, Parser *p);
+
 #endif